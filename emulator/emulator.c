@@ -0,0 +1,118 @@
+/**
+ * emulator.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) agent <agent@local>, October 2026.
+ */
+
+
+#include "emulator.h"
+
+#include <ISO7816.h>
+#include <string.h>
+
+#include "defs_externals.h"
+
+// The applet entry point, see multoscomms.h
+void idemix_main(void);
+
+/**
+ * Determine the ISO 7816-3 case, Lc and Le of a command APDU.
+ *
+ * @return the offset of the command data, or zero if the encoding is
+ *         invalid
+ */
+static int decode(const unsigned char *command, int length) {
+  int lc;
+
+  if (length == 4) {
+    multosAPDU.apduCase = 1;
+    return 4;
+  }
+
+  // Short length encoding
+  if (command[4] != 0x00 || length == 5) {
+    lc = command[4];
+    if (length == 5) {
+      multosAPDU.apduCase = 2;
+      multosAPDU.le = lc == 0 ? 256 : lc;
+      return 5;
+    }
+    multosAPDU.lc = lc;
+    if (length == 5 + lc) {
+      multosAPDU.apduCase = 3;
+      return 5;
+    }
+    if (length == 6 + lc) {
+      multosAPDU.apduCase = 4;
+      multosAPDU.le = command[length - 1] == 0 ? 256 : command[length - 1];
+      return 5;
+    }
+    return 0;
+  }
+
+  // Extended length encoding
+  if (length < 7) {
+    return 0;
+  }
+  lc = (command[5] << 8) | command[6];
+  if (length == 7) {
+    multosAPDU.apduCase = 2;
+    multosAPDU.le = lc == 0 ? 65536 : lc;
+    return 7;
+  }
+  multosAPDU.lc = lc;
+  if (lc != 0 && length == 7 + lc) {
+    multosAPDU.apduCase = 3;
+    return 7;
+  }
+  if (lc != 0 && length == 9 + lc) {
+    multosAPDU.apduCase = 4;
+    multosAPDU.le = (command[length - 2] << 8) | command[length - 1];
+    multosAPDU.le = multosAPDU.le == 0 ? 65536 : multosAPDU.le;
+    return 7;
+  }
+  return 0;
+}
+
+int emulator_transmit(const unsigned char *command, int length,
+    unsigned char *response) {
+  int offset;
+
+  memset(&multosAPDU, 0x00, sizeof(MultosAPDU));
+  multosAPDU.sw = ISO7816_SW_NO_ERROR;
+
+  offset = length >= 4 ? decode(command, length) : 0;
+  if (offset == 0 || multosAPDU.lc > SIZE_PUBLIC) {
+    multosAPDU.sw = ISO7816_SW_WRONG_LENGTH;
+  } else {
+    multosAPDU.cla = command[0];
+    multosAPDU.ins = command[1];
+    multosAPDU.p1 = command[2];
+    multosAPDU.p2 = command[3];
+    memcpy(public.apdu.data, command + offset, multosAPDU.lc);
+
+    // The applet returns here through multos_exit()
+    if (setjmp(multosExit) == 0) {
+      idemix_main();
+    }
+  }
+
+  length = multosAPDU.la < SIZE_PUBLIC ? multosAPDU.la : SIZE_PUBLIC;
+  memcpy(response, public.apdu.data, length);
+  response[length++] = multosAPDU.sw >> 8;
+  response[length++] = multosAPDU.sw & 0xFF;
+  return length;
+}
@@ -0,0 +1,49 @@
+/**
+ * emulator.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) agent <agent@local>, October 2026.
+ */
+
+
+#ifndef __emulator_H
+#define __emulator_H
+
+#include <setjmp.h>
+
+#include "defs_sizes.h"
+
+// Maximum size of a response APDU: the public segment and the status word
+#define EMULATOR_MAX_RESPONSE (SIZE_PUBLIC + 2)
+
+extern jmp_buf multosExit;
+
+/**
+ * Process a command APDU by the applet, as a MULTOS card would.
+ *
+ * The command may use short or extended length encoding (ISO 7816-3).
+ * The static and session variables of the applet persist between
+ * commands for the lifetime of the process, which is a single session.
+ *
+ * @param command APDU (header, optional Lc and data, optional Le)
+ * @param length of the command APDU
+ * @param response to store the response APDU (data and status word), of
+ *        at least EMULATOR_MAX_RESPONSE bytes
+ * @return the length of the response APDU
+ */
+int emulator_transmit(const unsigned char *command, int length,
+  unsigned char *response);
+
+#endif // __emulator_H
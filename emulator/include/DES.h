@@ -0,0 +1,43 @@
+/**
+ * DES.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) agent <agent@local>, October 2026.
+ */
+
+
+#ifndef __DES_H
+#define __DES_H
+
+/********************************************************************/
+/* Emulated MULTOS (two key) triple DES primitives                  */
+/********************************************************************/
+
+void multos_3des_cbc(unsigned int length, const unsigned char *in,
+  const unsigned char *iv, const unsigned char *key, unsigned char *out,
+  int encipher);
+void multos_3des_mac(unsigned int length, const unsigned char *iv,
+  const unsigned char *key, unsigned char *result, const unsigned char *data);
+
+#define TripleDES2KeyCBCEncipherMessageNoPad(MessageLength, PlainText, InitialValue, Key, CipherText) \
+  multos_3des_cbc(MessageLength, PlainText, InitialValue, Key, CipherText, 1)
+
+#define TripleDES2KeyCBCDecipherMessageNoPad(MessageLength, CipherText, InitialValue, Key, PlainText) \
+  multos_3des_cbc(MessageLength, CipherText, InitialValue, Key, PlainText, 0)
+
+#define GenerateTripleDESCBCSignature(MessageLength, InitialValue, Key, Result, Message) \
+  multos_3des_mac(MessageLength, InitialValue, Key, Result, Message)
+
+#endif // __DES_H
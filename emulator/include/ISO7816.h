@@ -0,0 +1,47 @@
+/**
+ * ISO7816.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) agent <agent@local>, October 2026.
+ */
+
+
+#ifndef __ISO7816_H
+#define __ISO7816_H
+
+#include <multoscomms.h>
+
+// Class and instruction bytes
+#define ISO7816_CLA                              0x00
+#define ISO7816_INS_VERIFY                       0x20
+#define ISO7816_INS_EXTERNAL_AUTHENTICATE        0x82
+#define ISO7816_INS_INTERNAL_AUTHENTICATE        0x88
+
+// Status words
+#define ISO7816_SW_NO_ERROR                      0x9000
+#define ISO7816_SW_COUNTER_PROVIDED_BY_X(x)      (0x63C0 | ((x) & 0x0F))
+#define ISO7816_SW_WRONG_LENGTH                  0x6700
+#define ISO7816_SW_SECURITY_STATUS_NOT_SATISFIED 0x6982
+#define ISO7816_SW_DATA_INVALID                  0x6984
+#define ISO7816_SW_CONDITIONS_NOT_SATISFIED      0x6985
+#define ISO7816_SW_COMMAND_NOT_ALLOWED           0x6986
+#define ISO7816_SW_WRONG_DATA                    0x6A80
+#define ISO7816_SW_REFERENCED_DATA_NOT_FOUND     0x6A88
+#define ISO7816_SW_WRONG_P1P2                    0x6B00
+#define ISO7816_SW_INS_NOT_SUPPORTED             0x6D00
+#define ISO7816_SW_CLA_NOT_SUPPORTED             0x6E00
+#define ISO7816_SW_COMMAND_NOT_ALLOWED_AGAIN     0x6986
+
+#endif // __ISO7816_H
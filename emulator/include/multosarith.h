@@ -0,0 +1,56 @@
+/**
+ * multosarith.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) agent <agent@local>, October 2026.
+ */
+
+
+#ifndef __multosarith_H
+#define __multosarith_H
+
+#include <string.h>
+
+#include <multosccr.h>
+
+/********************************************************************/
+/* Emulated MULTOS block arithmetic (big-endian, updates the CCR)   */
+/********************************************************************/
+
+void multos_addn(int length, unsigned char *block1, const unsigned char *block2);
+void multos_subn(int length, unsigned char *block1, const unsigned char *block2);
+void multos_incn(int length, unsigned char *block);
+void multos_testn(int length, const unsigned char *block);
+
+/**
+ * Primitive Multiply: result (2*length bytes) = block1 * block2.
+ *
+ * The card invokes this primitive through MEL, since hcl has no C API
+ * for it.
+ */
+void multos_multiply(int length, const unsigned char *block1,
+  const unsigned char *block2, unsigned char *result);
+
+#define COPYN(length, dest, src) memmove((dest), (src), (length))
+#define CLEARN(length, dest) memset((dest), 0x00, (length))
+
+// block1 = block1 + block2, block1 = block1 - block2
+#define ADDN(length, block1, block2) multos_addn((length), (block1), (block2))
+#define SUBN(length, block1, block2) multos_subn((length), (block1), (block2))
+
+#define INCN(length, block) multos_incn((length), (block))
+#define TESTN(length, block) multos_testn((length), (block))
+
+#endif // __multosarith_H
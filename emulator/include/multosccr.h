@@ -0,0 +1,40 @@
+/**
+ * multosccr.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) agent <agent@local>, October 2026.
+ */
+
+
+#ifndef __multosccr_H
+#define __multosccr_H
+
+/********************************************************************/
+/* Emulated MULTOS condition code register                          */
+/********************************************************************/
+
+#define MULTOS_CCR_C 0x08
+#define MULTOS_CCR_Z 0x04
+
+extern unsigned char multosCCR;
+
+// Store whether the zero (Z) or carry (C) flag is set
+#define ZFlag(result) \
+  (*(result) = (multosCCR & MULTOS_CCR_Z) != 0)
+
+#define CFlag(result) \
+  (*(result) = (multosCCR & MULTOS_CCR_C) != 0)
+
+#endif // __multosccr_H
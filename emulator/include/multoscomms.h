@@ -0,0 +1,84 @@
+/**
+ * multoscomms.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) agent <agent@local>, October 2026.
+ */
+
+
+#ifndef __multoscomms_H
+#define __multoscomms_H
+
+/********************************************************************/
+/* Emulated MULTOS communication API (see emulator/multos.c)        */
+/********************************************************************/
+
+// Command and response registers of the APDU which is being processed
+typedef struct {
+  unsigned char cla, ins, p1, p2;
+  unsigned int lc, le, la;
+  unsigned int sw;
+  unsigned char apduCase;
+} MultosAPDU;
+
+extern MultosAPDU multosAPDU;
+
+#define CLA (multosAPDU.cla)
+#define INS (multosAPDU.ins)
+#define P1 (multosAPDU.p1)
+#define P2 (multosAPDU.p2)
+#define P1P2 ((unsigned int) (multosAPDU.p1 << 8) | multosAPDU.p2)
+#define Lc (multosAPDU.lc)
+#define Le (multosAPDU.le)
+#define La (multosAPDU.la)
+#define SW1 (multosAPDU.sw >> 8)
+#define SW2 (multosAPDU.sw & 0xFF)
+
+// The applet entry point is called for each command by emulator_transmit()
+#define main idemix_main
+
+/**
+ * Check whether the command has the given ISO 7816 case (1 to 4).
+ */
+int multos_check_case(unsigned char apduCase);
+
+/**
+ * Stop processing the command, as the MULTOS exit instruction does.
+ */
+void multos_exit(void) __attribute__((noreturn));
+
+#define CheckCase(apduCase) multos_check_case(apduCase)
+
+#define SetSW(SW) \
+  (multosAPDU.sw = (SW))
+
+#define SetSWLa(SW, LA) \
+  (multosAPDU.sw = (SW), multosAPDU.la = (LA))
+
+#define Exit() multos_exit()
+
+#define ExitSW(SW) \
+do { \
+  SetSW(SW); \
+  Exit(); \
+} while (0)
+
+#define ExitSWLa(SW, LA) \
+do { \
+  SetSWLa(SW, LA); \
+  Exit(); \
+} while (0)
+
+#endif // __multoscomms_H
@@ -0,0 +1,72 @@
+/**
+ * multoscrypto.h
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) agent <agent@local>, October 2026.
+ */
+
+
+#ifndef __multoscrypto_H
+#define __multoscrypto_H
+
+/********************************************************************/
+/* Emulated MULTOS cryptographic primitives (see emulator/multos.c) */
+/********************************************************************/
+
+void multos_random(unsigned char *result);
+void multos_modexp(unsigned int exponentLength, unsigned int modulusLength,
+  const unsigned char *exponent, const unsigned char *modulus,
+  const unsigned char *base, unsigned char *result);
+void multos_modmul(unsigned int modulusLength, unsigned char *lhs,
+  const unsigned char *rhs, const unsigned char *modulus);
+void multos_sha1(unsigned int length, unsigned char *digest,
+  const unsigned char *text);
+void multos_sha256(unsigned int length, unsigned char *digest,
+  const unsigned char *text);
+void multos_aes_encipher(const unsigned char *in, unsigned char *out,
+  unsigned char keyLength, const unsigned char *key, int encipher);
+
+/**
+ * Scalar multiplication on the curve of the given domain parameters,
+ * with the points encoded uncompressed (0x04 | x | y).
+ */
+void multos_ecc_multiply(const unsigned char *domain,
+  const unsigned char *point, const unsigned char *scalar,
+  unsigned char *result);
+
+/**
+ * Set the Z flag if the point is on the curve of the domain parameters.
+ */
+void multos_ecc_verify(const unsigned char *domain, const unsigned char *point);
+
+#define GetRandomNumber(RandomNumber) \
+  multos_random(RandomNumber)
+
+#define ModularExponentiation(ExponentLength, ModulusLength, Exponent, Modulus, Base, Result) \
+  multos_modexp(ExponentLength, ModulusLength, Exponent, Modulus, Base, Result)
+
+#define ModularMultiplication(ModulusLength, LHS, RHS, Modulus) \
+  multos_modmul(ModulusLength, LHS, RHS, Modulus)
+
+#define SHA1(PlainTextLength, HashDigest, PlainText) \
+  multos_sha1(PlainTextLength, HashDigest, PlainText)
+
+#define AESECBEncipher(PlainText, CipherText, KeyLength, Key) \
+  multos_aes_encipher(PlainText, CipherText, KeyLength, Key, 1)
+
+#define AESECBDecipher(CipherText, PlainText, KeyLength, Key) \
+  multos_aes_encipher(CipherText, PlainText, KeyLength, Key, 0)
+
+#endif // __multoscrypto_H
@@ -0,0 +1,71 @@
+/**
+ * main.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) agent <agent@local>, October 2026.
+ */
+
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "emulator.h"
+
+#define SIZE_LINE 8192
+
+/**
+ * Send hexadecimal command APDUs, one per line, from standard input to
+ * the emulated applet and print the response APDUs. Empty lines and
+ * lines starting with '#' are skipped.
+ */
+int main(void) {
+  char line[SIZE_LINE];
+  unsigned char command[SIZE_LINE / 2], response[EMULATOR_MAX_RESPONSE];
+  int i, length;
+  unsigned int byte;
+  char *c;
+
+  while (fgets(line, SIZE_LINE, stdin) != NULL) {
+    if (line[0] == '#') {
+      continue;
+    }
+
+    // Parse the command, ignoring white space
+    length = 0;
+    for (c = line; *c != '\0'; c++) {
+      if (isxdigit((unsigned char) c[0]) && isxdigit((unsigned char) c[1]) &&
+          sscanf(c, "%2x", &byte) == 1) {
+        command[length++] = byte;
+        c++;
+      } else if (!isspace((unsigned char) *c)) {
+        fprintf(stderr, "Invalid command: %s", line);
+        return 1;
+      }
+    }
+    if (length == 0) {
+      continue;
+    }
+
+    length = emulator_transmit(command, length, response);
+    for (i = 0; i < length; i++) {
+      printf("%02X", response[i]);
+    }
+    printf("\n");
+    fflush(stdout);
+  }
+
+  return 0;
+}
@@ -0,0 +1,314 @@
+/**
+ * multos.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) agent <agent@local>, October 2026.
+ */
+
+
+#include <openssl/bn.h>
+#include <openssl/ec.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+#include <setjmp.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <multoscomms.h>
+#include <multosarith.h>
+#include <multosccr.h>
+#include <multoscrypto.h>
+#include <DES.h>
+
+#include "emulator.h"
+
+/********************************************************************/
+/* Emulated MULTOS registers                                        */
+/********************************************************************/
+
+MultosAPDU multosAPDU;
+unsigned char multosCCR;
+
+// Context to return to when the applet exits (see emulator_transmit())
+jmp_buf multosExit;
+
+int multos_check_case(unsigned char apduCase) {
+  return multosAPDU.apduCase == apduCase;
+}
+
+void multos_exit(void) {
+  longjmp(multosExit, 1);
+}
+
+/********************************************************************/
+/* Block arithmetic                                                 */
+/********************************************************************/
+
+void multos_addn(int length, unsigned char *block1, const unsigned char *block2) {
+  int i, t = 0;
+
+  for (i = length - 1; i >= 0; i--) {
+    t += block1[i] + block2[i];
+    block1[i] = t & 0xFF;
+    t >>= 8;
+  }
+  multosCCR = t != 0 ? multosCCR | MULTOS_CCR_C : multosCCR & ~MULTOS_CCR_C;
+}
+
+void multos_subn(int length, unsigned char *block1, const unsigned char *block2) {
+  int i, t = 0;
+
+  for (i = length - 1; i >= 0; i--) {
+    t = block1[i] - block2[i] - t;
+    block1[i] = t & 0xFF;
+    t = t < 0;
+  }
+  multosCCR = t != 0 ? multosCCR | MULTOS_CCR_C : multosCCR & ~MULTOS_CCR_C;
+}
+
+void multos_incn(int length, unsigned char *block) {
+  int i;
+
+  for (i = length - 1; i >= 0 && ++block[i] == 0x00; i--);
+  multosCCR = i < 0 ? multosCCR | MULTOS_CCR_C : multosCCR & ~MULTOS_CCR_C;
+}
+
+void multos_testn(int length, const unsigned char *block) {
+  int i;
+
+  for (i = 0; i < length && block[i] == 0x00; i++);
+  multosCCR = i == length ? multosCCR | MULTOS_CCR_Z : multosCCR & ~MULTOS_CCR_Z;
+}
+
+void multos_multiply(int length, const unsigned char *block1,
+    const unsigned char *block2, unsigned char *result) {
+  int i, j, t;
+
+  memset(result, 0x00, 2*length);
+  for (i = length - 1; i >= 0; i--) {
+    t = 0;
+    for (j = length - 1; j >= 0; j--) {
+      t += result[i + j + 1] + block1[i] * block2[j];
+      result[i + j + 1] = t & 0xFF;
+      t >>= 8;
+    }
+    result[i] = t;
+  }
+}
+
+/********************************************************************/
+/* Cryptographic primitives (backed by OpenSSL)                     */
+/********************************************************************/
+
+void multos_random(unsigned char *result) {
+  RAND_bytes(result, 8);
+}
+
+void multos_modexp(unsigned int exponentLength, unsigned int modulusLength,
+    const unsigned char *exponent, const unsigned char *modulus,
+    const unsigned char *base, unsigned char *result) {
+  BN_CTX *ctx = BN_CTX_new();
+  BIGNUM *e = BN_bin2bn(exponent, exponentLength, NULL);
+  BIGNUM *n = BN_bin2bn(modulus, modulusLength, NULL);
+  BIGNUM *x = BN_bin2bn(base, modulusLength, NULL);
+
+  BN_mod_exp(x, x, e, n, ctx);
+  BN_bn2binpad(x, result, modulusLength);
+
+  BN_free(x);
+  BN_free(n);
+  BN_clear_free(e);
+  BN_CTX_free(ctx);
+}
+
+void multos_modmul(unsigned int modulusLength, unsigned char *lhs,
+    const unsigned char *rhs, const unsigned char *modulus) {
+  BN_CTX *ctx = BN_CTX_new();
+  BIGNUM *x = BN_bin2bn(lhs, modulusLength, NULL);
+  BIGNUM *y = BN_bin2bn(rhs, modulusLength, NULL);
+  BIGNUM *n = BN_bin2bn(modulus, modulusLength, NULL);
+
+  BN_mod_mul(x, x, y, n, ctx);
+  BN_bn2binpad(x, lhs, modulusLength);
+
+  BN_free(n);
+  BN_free(y);
+  BN_free(x);
+  BN_CTX_free(ctx);
+}
+
+void multos_sha1(unsigned int length, unsigned char *digest,
+    const unsigned char *text) {
+  unsigned char result[EVP_MAX_MD_SIZE];
+
+  // The digest may overlap with the text
+  EVP_Digest(text, length, result, NULL, EVP_sha1(), NULL);
+  memcpy(digest, result, 20);
+}
+
+void multos_sha256(unsigned int length, unsigned char *digest,
+    const unsigned char *text) {
+  unsigned char result[EVP_MAX_MD_SIZE];
+
+  EVP_Digest(text, length, result, NULL, EVP_sha256(), NULL);
+  memcpy(digest, result, 32);
+}
+
+/**
+ * Run a block cipher (without padding) over length bytes.
+ */
+static void cipher(const EVP_CIPHER *type, const unsigned char *key,
+    const unsigned char *iv, int encipher, unsigned int length,
+    const unsigned char *in, unsigned char *out) {
+  EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+  int size;
+
+  EVP_CipherInit_ex(ctx, type, NULL, key, iv, encipher);
+  EVP_CIPHER_CTX_set_padding(ctx, 0);
+  EVP_CipherUpdate(ctx, out, &size, in, length);
+  EVP_CIPHER_CTX_free(ctx);
+}
+
+void multos_aes_encipher(const unsigned char *in, unsigned char *out,
+    unsigned char keyLength, const unsigned char *key, int encipher) {
+  cipher(keyLength == 32 ? EVP_aes_256_ecb() :
+    keyLength == 24 ? EVP_aes_192_ecb() : EVP_aes_128_ecb(),
+    key, NULL, encipher, 16, in, out);
+}
+
+void multos_3des_cbc(unsigned int length, const unsigned char *in,
+    const unsigned char *iv, const unsigned char *key, unsigned char *out,
+    int encipher) {
+  unsigned char *copy = malloc(length);
+
+  // The card processes the data block by block, such that the output may
+  // also be in front of the input in the same buffer
+  memcpy(copy, in, length);
+  cipher(EVP_des_ede_cbc(), key, iv, encipher, length, copy, out);
+  free(copy);
+}
+
+void multos_3des_mac(unsigned int length, const unsigned char *iv,
+    const unsigned char *key, unsigned char *result, const unsigned char *data) {
+  unsigned char chain[8];
+  unsigned int i, j;
+
+  // CBC-MAC: the last block of the CBC encryption of the data
+  memcpy(chain, iv, 8);
+  for (i = 0; i < length; i += 8) {
+    for (j = 0; j < 8; j++) {
+      chain[j] ^= data[i + j];
+    }
+    cipher(EVP_des_ede_ecb(), key, NULL, 1, 8, chain, chain);
+  }
+  memcpy(result, chain, 8);
+}
+
+/**
+ * Construct the curve of the given domain parameters, of which only the
+ * prime field format 0x00 is supported:
+ *
+ *   0x00 | size | p | a | b | G (uncompressed) | n | h
+ *
+ * @return the curve, or NULL if the parameters are not supported
+ */
+static EC_GROUP *ecc_group(const unsigned char *domain) {
+  int size = domain[1];
+  const unsigned char *p = domain + 2, *a = p + size, *b = a + size,
+    *g = b + size, *n = g + 1 + 2*size, *h = n + size;
+  BIGNUM *bp, *ba, *bb, *bn, *bh;
+  EC_GROUP *group = NULL;
+  EC_POINT *generator;
+
+  if (domain[0] != 0x00) {
+    return NULL;
+  }
+
+  bp = BN_bin2bn(p, size, NULL);
+  ba = BN_bin2bn(a, size, NULL);
+  bb = BN_bin2bn(b, size, NULL);
+  bn = BN_bin2bn(n, size, NULL);
+  bh = BN_bin2bn(h, 1, NULL);
+  group = EC_GROUP_new_curve_GFp(bp, ba, bb, NULL);
+  if (group != NULL) {
+    generator = EC_POINT_new(group);
+    if (EC_POINT_oct2point(group, generator, g, 1 + 2*size, NULL) != 1 ||
+        EC_GROUP_set_generator(group, generator, bn, bh) != 1) {
+      EC_GROUP_free(group);
+      group = NULL;
+    }
+    EC_POINT_free(generator);
+  }
+
+  BN_free(bh);
+  BN_free(bn);
+  BN_free(bb);
+  BN_free(ba);
+  BN_free(bp);
+  return group;
+}
+
+/**
+ * Decode an uncompressed point on the curve.
+ *
+ * @return the point, or NULL if it is not on the curve
+ */
+static EC_POINT *ecc_point(const EC_GROUP *group, int size,
+    const unsigned char *point) {
+  EC_POINT *p;
+
+  if (group == NULL) {
+    return NULL;
+  }
+  p = EC_POINT_new(group);
+  if (EC_POINT_oct2point(group, p, point, 1 + 2*size, NULL) != 1 ||
+      EC_POINT_is_on_curve(group, p, NULL) != 1) {
+    EC_POINT_free(p);
+    return NULL;
+  }
+  return p;
+}
+
+void multos_ecc_multiply(const unsigned char *domain,
+    const unsigned char *point, const unsigned char *scalar,
+    unsigned char *result) {
+  EC_GROUP *group = ecc_group(domain);
+  EC_POINT *p = ecc_point(group, domain[1], point), *r = NULL;
+  BIGNUM *k = BN_bin2bn(scalar, domain[1], NULL);
+
+  if (p != NULL && (r = EC_POINT_new(group)) != NULL &&
+      EC_POINT_mul(group, r, NULL, p, k, NULL) == 1) {
+    EC_POINT_point2oct(group, r, POINT_CONVERSION_UNCOMPRESSED,
+      result, 1 + 2*domain[1], NULL);
+  } else {
+    memset(result, 0x00, 1 + 2*domain[1]);
+  }
+
+  BN_clear_free(k);
+  EC_POINT_free(r);
+  EC_POINT_free(p);
+  EC_GROUP_free(group);
+}
+
+void multos_ecc_verify(const unsigned char *domain, const unsigned char *point) {
+  EC_GROUP *group = ecc_group(domain);
+  EC_POINT *p = ecc_point(group, domain[1], point);
+
+  multosCCR = p != NULL ?
+    multosCCR | MULTOS_CCR_Z : multosCCR & ~MULTOS_CCR_Z;
+
+  EC_POINT_free(p);
+  EC_GROUP_free(group);
+}
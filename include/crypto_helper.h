@@ -22,6 +22,11 @@
 
 #include "defs_types.h"
 
+/**
+ * Domain parameters of the NIST P-256 curve
+ */
+extern const Byte eccDomain[];
+
 /**
  * Compute a cryptographic hash of the given input values
  * 
@@ -42,10 +47,37 @@ void crypto_compute_hash(ValueArray list, int length, ByteArray result,
  */
 void crypto_generate_random(ByteArray buffer, int length);
 
+/**
+ * Derive a pseudo-random number of length bits from a seed
+ *
+ * @param seed of SIZE_SEED bytes to derive the number from
+ * @param index of the number to derive from the seed
+ * @param buffer to store the derived number
+ * @param length in bits of the number to derive
+ */
+void crypto_derive_random(ByteArray seed, Byte index, ByteArray buffer, int length);
+
+/**
+ * Compute the multiply-accumulate: result = result +/- a*b
+ *
+ * Operands of any size are supported; they are multiplied in limbs of
+ * SIZE_MUL_LIMB bytes by the PRIM_MULTIPLY primitive.
+ *
+ * @param result to accumulate the product into
+ * @param size of the result
+ * @param a first operand
+ * @param sizeA of the first operand
+ * @param b second operand
+ * @param sizeB of the second operand
+ * @param subtract whether to subtract the product instead of adding it
+ */
+void crypto_multiply_add(ByteArray result, int size, ByteArray a, int sizeA,
+                         ByteArray b, int sizeB, Byte subtract);
+
 /**
  * Compute the helper value S' = S^(2_l) where l = SIZE_S_EXPONENT*8
- * 
- * This value is required for exponentiations with base S and an 
+ *
+ * This value is required for exponentiations with base S and an
  * exponent which is larger than SIZE_N bytes.
  */
 void crypto_compute_S_(void);
@@ -53,15 +85,32 @@ void crypto_compute_S_(void);
 /**
  * Compute the modular exponentiation: result = S^exponent mod n
  * 
- * This function will use the helper value S' to compute exponentiations 
+ * This function will use the helper value S' to compute exponentiations
  * with exponents larger than SIZE_N bytes.
  * 
  * @param size of the exponent
  * @param exponent the power to which the base S should be raised
  * @param result of the computation
+ * @param buffer for temporary storage of SIZE_N bytes
  */
 void crypto_modexp_special(int size, ByteArray exponent, ByteArray result, ByteArray buffer);
 
+/**
+ * Compute the product of modular exponentiations:
+ *   result = base[0]^exponent[0] * ... * base[count-1]^exponent[count-1] mod n
+ *
+ * Every power is computed by the (hardware) modular exponentiation
+ * primitive, after which the powers are multiplied.
+ *
+ * @param list of powers (base, exponent, size) to be multiplied
+ * @param count of the powers in the list
+ * @param modulus for the computation
+ * @param result of the computation
+ * @param buffer for temporary storage of SIZE_N bytes
+ */
+void crypto_modexp_product(PowerArray list, int count, ByteArray modulus,
+                         ByteArray result, ByteArray buffer);
+
 /**
  * Clear size bytes from a bytearray
  *
@@ -20,13 +20,110 @@
 #ifndef __crypto_issuing_H
 #define __crypto_issuing_H
 
+#include "defs_types.h"
+
+/**
+ * Precompute the nonce independent part of the commitment (round 1)
+ */
+void precomputeCommitment(void);
+
 /**
  * Construct a commitment (round 1)
  */
 void constructCommitment(void);
 
 /**
- * Construct the signature (round 3, part 1)
+ * Find the issuer key for a new credential.
+ */
+Byte findIssuerKey(ByteArray fingerprint);
+
+/**
+ * Count the credentials which use issuer key k.
+ */
+Byte countIssuerKeyUsers(Byte k);
+
+/**
+ * Release the issuer key of the current credential.
+ */
+void releaseIssuerKey(void);
+
+/**
+ * Complete the issuer key component j once it has been stored.
+ */
+void completeIssuerKey(Byte j);
+
+/**
+ * Store a segment of a bulk upload of the issuer key and attributes.
+ */
+int storeBulk(int offset, ByteArray data, int length);
+
+/**
+ * Size of a bulk upload: n, Z, S, R[0], ..., R[l], m[1], ..., m[l]
+ */
+#define SIZE_BULK(l) ((KEY_R + 1 + (l))*SIZE_N + (l)*SIZE_M)
+
+/**
+ * Remove the current credential.
+ */
+void removeCredential(void);
+
+/**
+ * Roll back the issuance of the pending credential.
+ */
+void abortIssuance(void);
+
+/**
+ * Compute R[0]^m[0] mod n, or take it from the issuer key if cached.
+ */
+void computeMasterPower(ByteArray result);
+
+/**
+ * Index of the issuer key components, in the order of upload
+ */
+#define KEY_N 0
+#define KEY_Z 1
+#define KEY_S 2
+#define KEY_R 3
+
+/**
+ * Whether U and UTilde have been precomputed for the current issuance
+ */
+#define FLAG_ISSUE_PRECOMPUTED 0x01
+
+/**
+ * Whether the current credential has been committed in this session
+ */
+#define FLAG_ISSUE_SIGNED 0x08
+
+/**
+ * Whether a chained bulk upload is in progress
+ */
+#define FLAG_ISSUE_BULK 0x10
+
+/**
+ * Whether the commitment and its responses have been constructed
+ */
+#define FLAG_ISSUE_COMMITTED 0x20
+
+/**
+ * Parts of the signature which have been staged in session.sign
+ */
+#define STAGED_SIGNATURE_A 0x01
+#define STAGED_SIGNATURE_E 0x02
+
+/**
+ * Whether Q = A^e of the committed signature is cached in session.vfyPrf.Q
+ */
+#define STAGED_SIGNATURE_Q 0x04
+
+/**
+ * Whether session.sign.vPrime belongs to the commitment constructed for
+ * the pending credential in this session
+ */
+#define STAGED_COMMITMENT 0x08
+
+/**
+ * Construct the signature (round 3, part 1) and commit the credential
  */
 void constructSignature(void);
 
@@ -43,48 +140,19 @@ void verifyProof(void);
 /**
  * Compute the response value vPrimeHat = vPrimeTilde + c*vPrime
  * 
- * Requires vPrimeTilde to be stored in vPrimeHat.
+ * Requires vPrimeTilde to be copied to vPrimeHat.
  */
 #define crypto_compute_vPrimeHat() \
-do { \
-  /* Clear the buffer, to prevent garbage messing up the computation */\
-  __code(CLEARN, public.issue.buffer.data, SIZE_VPRIME_ - SIZE_VPRIME); \
-  /* Multiply c (padded to match size) with least significant part of vPrime */\
-  __code(PUSHZ, SIZE_VPRIME/2 - SIZE_H); \
-  __push(BLOCKCAST(SIZE_H)(session.issue.challenge)); \
-  __push(BLOCKCAST(SIZE_VPRIME/2)(session.issue.vPrime + SIZE_VPRIME/2)); \
-  __code(PRIM, PRIM_MULTIPLY, SIZE_VPRIME/2); \
-  __code(STORE, public.issue.buffer.data + SIZE_VPRIME_ - SIZE_VPRIME, SIZE_VPRIME); \
-  /* Multiply c (padded to match size) with most significant part of vPrime */\
-  __code(PUSHZ, SIZE_VPRIME/2 - SIZE_H); \
-  __push(BLOCKCAST(SIZE_H)(session.issue.challenge)); \
-  __push(BLOCKCAST(SIZE_VPRIME/2)(session.issue.vPrime)); \
-  __code(PRIM, PRIM_MULTIPLY, SIZE_VPRIME/2); \
-  /* Combine the two multiplications into a single result */\
-  __code(ADDN, public.issue.buffer.data, SIZE_VPRIME_ - SIZE_VPRIME/2); \
-  __code(POPN, SIZE_VPRIME); \
-  /* Add vPrimeTilde and store the result in vPrimeHat */\
-  __push(BLOCKCAST(SIZE_VPRIME_)(public.issue.buffer.data)); \
-  __code(ADDN, session.issue.vPrimeHat, SIZE_VPRIME_); \
-  __code(POPN, SIZE_VPRIME_); \
-} while (0)
+  crypto_multiply_add(session.issue.proof.response.vPrimeHat, SIZE_VPRIME_, \
+    session.issue.challenge, SIZE_H, session.issue.vPrime, SIZE_VPRIME, 0)
 
 /**
  * Compute the response value sHat = sTilde + c * s
  * 
- * Requires sTilde to be stored in sHat.
+ * Requires sTilde to be copied to sHat.
  */
 #define crypto_compute_sHat() \
-do { \
-  /* Multiply c with m */\
-  __code(PUSHZ, SIZE_S_ - 2*SIZE_M); \
-  __push(BLOCKCAST(SIZE_H)(session.issue.challenge)); \
-  __push(BLOCKCAST(SIZE_M)(masterSecret)); \
-  __code(PRIM, PRIM_MULTIPLY, SIZE_M); \
-  /* Add the result of the multiplication to sTilde and store in sHat */\
-  __code(ADDN, session.issue.sHat, SIZE_S_); \
-  /* Cleanup the stack */\
-  __code(POPN, SIZE_S_); \
-} while (0)
+  crypto_multiply_add(session.issue.proof.response.sHat, SIZE_S_, \
+    session.issue.challenge, SIZE_H, masterSecret, SIZE_M, 0)
 
 #endif // __crypto_issuing_H
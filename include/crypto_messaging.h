@@ -32,6 +32,39 @@ void crypto_unwrap(void);
  */
 void crypto_wrap(void);
 
+/**
+ * Ciphers for secure messaging, selected by P1 of INTERNAL AUTHENTICATE
+ */
+#define CIPHER_3DES 0x00 // two-key TripleDES CBC and retail MAC
+#define CIPHER_AES 0x01 // AES-128 CBC and CMAC
+
+/**
+ * Encrypt data in place for secure messaging
+ *
+ * @param length of the (padded) data
+ * @param data to be encrypted
+ */
+void crypto_encipher(int length, ByteArray data);
+
+/**
+ * Decrypt data for secure messaging
+ *
+ * @param length of the (padded) data
+ * @param in the encrypted data
+ * @param out the decrypted data (in place or in front of in)
+ */
+void crypto_decipher(int length, ByteArray in, ByteArray out);
+
+/**
+ * Compute the MAC over data for secure messaging, possibly in parts
+ *
+ * @param length of the (padded) part
+ * @param data of the part
+ * @param chain value, zero before the first part and the MAC after the last
+ * @param last whether this is the last part
+ */
+void crypto_mac(int length, ByteArray data, ByteArray chain, Byte last);
+
 /**
  * Add padding to the input data according to ISO7816-4
  * 
@@ -54,7 +87,23 @@ uint unpad(ByteArray data, int size);
 
 /**
  * Perform card authentication and secure messaging setup
+ *
+ * @param newCipher for which the session keys are derived
+ */
+void crypto_authenticate_card(Byte newCipher);
+
+/**
+ * Perform card authentication and secure messaging setup using ECDH
+ *
+ * @param newCipher for which the session keys are derived
+ */
+void crypto_authenticate_card_ecdh(Byte newCipher);
+
+/**
+ * Resume secure messaging with the ticket of a previous session
+ *
+ * @param newCipher for which the session keys are derived
  */
-void crypto_authenticate_card(void);
+void crypto_resume_session(Byte newCipher);
 
 #endif // __crypto_messaging_H
@@ -26,6 +26,8 @@
 #define PRIM_RANDOM 0xc4
 #define PRIM_RSA_VERIFY 0xEB
 #define PRIM_SECURE_HASH 0xCF
+#define PRIM_ECC_MULTIPLY 0xD2
+#define PRIM_ECC_VERIFY_POINT 0xD4
 
 #define crypto_modmul(ModulusLength, LHS, RHS, Modulus) \
   ModularMultiplication(ModulusLength, LHS, RHS, Modulus)
@@ -35,8 +37,8 @@
 
 // Use the efficient RSA_VERIFY primitive on ML3
 #ifdef ML3
-// This primitive is not supported by the simulator
-#ifndef SIMULATOR
+// This primitive is not supported by the simulator (nor the emulator)
+#if !defined(SIMULATOR) && !defined(EMULATOR)
 
 #define crypto_modexp(ExponentLength, ModulusLength, Exponent, Modulus, Base, Result) \
 do { \
@@ -49,7 +51,7 @@ do { \
   __code(PRIM, PRIM_RSA_VERIFY); \
 } while (0)
 
-#endif // SIMULATOR
+#endif // !SIMULATOR && !EMULATOR
 #endif // ML3
 
 #ifndef crypto_modexp
@@ -59,6 +61,32 @@ do { \
 
 #endif // crypto_modexp
 
+#define crypto_aes_encipher(PlainText, CipherText, Key) \
+  AESECBEncipher(PlainText, CipherText, SIZE_KEY, Key)
+
+#define crypto_aes_decipher(CipherText, PlainText, Key) \
+  AESECBDecipher(CipherText, PlainText, SIZE_KEY, Key)
+
+#ifndef EMULATOR
+
+// Scalar multiplication Result = Scalar * Point on the curve of Domain
+#define crypto_ecc_multiply(Domain, Point, Scalar, Result) \
+do { \
+  __push(__typechk(unsigned char *, Domain)); \
+  __push(__typechk(unsigned char *, Point)); \
+  __push(__typechk(unsigned char *, Scalar)); \
+  __push(__typechk(unsigned char *, Result)); \
+  __code(PRIM, PRIM_ECC_MULTIPLY); \
+} while (0)
+
+// Verify that Point is on the curve of Domain (sets the Z flag if so)
+#define crypto_ecc_verify(Domain, Point) \
+do { \
+  __push(__typechk(unsigned char *, Domain)); \
+  __push(__typechk(unsigned char *, Point)); \
+  __code(PRIM, PRIM_ECC_VERIFY_POINT); \
+} while (0)
+
 #define SHA256(PlainTextLength, HashDigest, PlainText) \
 do { \
   __push(__typechk(unsigned int, PlainTextLength));	\
@@ -68,4 +96,18 @@ do { \
   __code(PRIM, PRIM_SECURE_HASH); \
 } while (0)
 
+#else // EMULATOR
+
+// The emulator provides the primitives which the card invokes through MEL
+#define crypto_ecc_multiply(Domain, Point, Scalar, Result) \
+  multos_ecc_multiply(Domain, Point, Scalar, Result)
+
+#define crypto_ecc_verify(Domain, Point) \
+  multos_ecc_verify(Domain, Point)
+
+#define SHA256(PlainTextLength, HashDigest, PlainText) \
+  multos_sha256(PlainTextLength, HashDigest, PlainText)
+
+#endif // EMULATOR
+
 #endif // __crypto_multos_H
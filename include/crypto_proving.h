@@ -28,68 +28,89 @@
  */
 void selectAttributes(int selection);
 
+/**
+ * Derive eTilde and vTilde from the seed of the proof into eHat and vHat.
+ */
+void deriveProofRandomness(void);
+
+/**
+ * Derive r_A from the seed of the proof into vHat.
+ */
+void deriveProofRA(void);
+
+/**
+ * Precompute the nonce independent part of a proof.
+ */
+void precomputeProof(void);
+
+/**
+ * Store a precomputed proof commitment in the pool.
+ */
+void pushProofCommitment(void);
+
+/**
+ * Take a precomputed proof commitment from the pool.
+ */
+Byte popProofCommitment(void);
+
+/**
+ * Remove all precomputed proof commitments for a credential from the pool.
+ */
+void dropProofCommitments(CredentialIdentifier id);
+
 /**
  * Construct a proof.
  */
 void constructProof(void);
 
+/**
+ * Compute the response m_i^ = m_i~ + c*m_i for a hidden attribute.
+ */
+void constructResponseM(Byte i, ByteArray mHat);
+
+/**
+ * Collect all the values of a proof in a single response.
+ */
+Size constructProofResponse(void);
+
+/**
+ * Whether A' and ZTilde have been precomputed for the current proof
+ */
+#define FLAG_PROVE_PRECOMPUTED 0x02
+
+/**
+ * Whether the responses of the current proof can be retrieved in parts
+ */
+#define FLAG_PROVE_CHALLENGED 0x04
+
+/**
+ * Indices of eTilde, vTilde and r_A in session.prove.seed, following those
+ * of mTilde[i] for i = 0, ..., SIZE_L - 1
+ */
+#define SEED_INDEX_E SIZE_L
+#define SEED_INDEX_V (SIZE_L + 1)
+#define SEED_INDEX_R_A (SIZE_L + 2)
+
 /**
  * Compute the value v' = v - e*r_A.
+ *
+ * Requires r_A to be stored in vHat.
  */
 #define crypto_compute_vPrime() \
 do { \
-  /* Clear the buffer, to prevent garbage messing up the computation */\
-  __code(CLEARN, public.prove.buffer.data, SIZE_V - 2*SIZE_E); \
-  /* Multiply e with least significant half of r_A */\
-  __code(PUSHZ, SIZE_E - SIZE_R_A/2); \
-  __push(BLOCKCAST(SIZE_R_A/2)(public.prove.rA + SIZE_R_A/2)); \
-  __push(BLOCKCAST(SIZE_E)(credential->signature.e)); \
-  __code(PRIM, PRIM_MULTIPLY, SIZE_E); \
-  __code(STORE, public.prove.buffer.data + SIZE_V - 2*SIZE_E, 2*SIZE_E); \
-  /* Multiply e with most significant half of r_A */\
-  __code(PUSHZ, SIZE_E - SIZE_R_A/2); \
-  __push(BLOCKCAST(SIZE_R_A/2)(public.prove.rA)); \
-  __push(BLOCKCAST(SIZE_E)(credential->signature.e)); \
-  __code(PRIM, PRIM_MULTIPLY, SIZE_E); \
-  /* Combine the two multiplications into a single result */\
-  __code(ADDN, public.prove.buffer.data, SIZE_V - SIZE_R_A/2); \
-  __code(POPN, 2*SIZE_E); \
-  /* Subtract from v and store the result in v' */\
-  __push(BLOCKCAST(SIZE_V)(credential->signature.v)); \
-  __push(BLOCKCAST(SIZE_V)(public.prove.buffer.data)); \
-  __code(SUBN, SIZE_V); \
-  __code(POPN, SIZE_V); \
-  __code(STORE, public.prove.buffer.data, SIZE_V); \
+  memcpy(public.prove.buffer.data, credential->signature.v, SIZE_V); \
+  crypto_multiply_add(public.prove.buffer.data, SIZE_V, \
+    credential->signature.e, SIZE_E, public.prove.vHat, SIZE_R_A, 1); \
 } while (0)
 
 /**
  * Compute the response value vHat = vTilde + c*v'.
  *
- * Requires vTilde to be stored in vHat.
+ * Requires vTilde to be stored in vHat and v' in the buffer.
  */
 #define crypto_compute_vHat() \
-do { \
-  /* Multiply c with least significant part of v */\
-  __code(PUSHZ, SIZE_V/2 - SIZE_H); \
-  __push(BLOCKCAST(SIZE_H)(public.prove.apdu.challenge)); \
-  __push(BLOCKCAST(SIZE_V/2)(public.prove.buffer.data + SIZE_V/2 + 1)); \
-  __code(PRIM, PRIM_MULTIPLY, SIZE_V/2); \
-  __code(STORE, public.prove.buffer.data + SIZE_V/2 + 1, 2*(SIZE_V/2)); \
-  /* Multiply c with most significant part of v */\
-  __code(PUSHZ, SIZE_V/2 + 1 - SIZE_H); \
-  __push(BLOCKCAST(SIZE_H)(public.prove.apdu.challenge)); \
-  __push(BLOCKCAST(SIZE_V/2 + 1)(public.prove.buffer.data)); \
-  __code(PRIM, PRIM_MULTIPLY, SIZE_V/2 + 1); \
-  /* Clear the buffer, to prevent garbage messing up the computation, do NOT do this earlier since it will destroy vPrime */\
-  __code(CLEARN, public.prove.buffer.data, SIZE_V/2 + 1); \
-  /* Combine the two multiplications into a single result */\
-  __code(ADDN, public.prove.buffer.data, SIZE_V); \
-  __code(POPN, SIZE_V + 1); \
-  /* Add vTilde and store the result in vHat */\
-  __push(BLOCKCAST(SIZE_V_)(public.prove.buffer.data + SIZE_V + SIZE_V/2 - SIZE_V_)); \
-  __code(ADDN, public.prove.vHat, SIZE_V_); \
-  __code(POPN, SIZE_V_); \
-} while (0)
+  crypto_multiply_add(public.prove.vHat, SIZE_V_, \
+    public.prove.apdu.challenge, SIZE_H, public.prove.buffer.data, SIZE_V, 0)
 
 /**
  * Compute the value e' = e - 2^(l_e' - 1).
@@ -104,43 +125,20 @@ do { \
  * Requires eTilde to be stored in eHat.
  */
 #define crypto_compute_eHat() \
-do { \
-  /* Multiply c with ePrime (SIZE_H since SIZE_H > SIZE_EPRIME) */\
-  __code(PUSHZ, SIZE_H - SIZE_EPRIME); \
-  __push(BLOCKCAST(SIZE_EPRIME)(credential->signature.e + SIZE_E - SIZE_EPRIME)); /* ePrime */\
-  __push(BLOCKCAST(SIZE_H)(public.prove.apdu.challenge)); \
-  __code(PRIM, PRIM_MULTIPLY, SIZE_H); \
-  /* Add eTilde and store the result in eHat */\
-  __code(ADDN, public.prove.eHat, SIZE_E_); \
-  /* Cleanup the stack */\
-  __code(POPN, 2*SIZE_H); \
-} while (0)
+  crypto_multiply_add(public.prove.eHat, SIZE_E_, public.prove.apdu.challenge, \
+    SIZE_H, credential->signature.e + SIZE_E - SIZE_EPRIME, SIZE_EPRIME, 0)
 
 /**
  * Compute the response value mHat[i] = mTilde[i] + c*m[i].
  *
- * Requires mTilde[i] to be stored in mHat[i].
+ * Requires mTilde[i] to be stored in mHat and c in session.prove.challenge.
  *
  * @param i index of the message to be hidden.
+ * @param mHat buffer of SIZE_M_ bytes holding mTilde[i].
  */
-#define crypto_compute_mHat(i) \
-do { \
-  /* Multiply c with m */\
-  __code(PUSHZ, SIZE_M_ + 2 - 2*SIZE_M); \
-  __push(BLOCKCAST(SIZE_H)(public.prove.apdu.challenge)); \
-  __push(BLOCKCAST(SIZE_M)(i == 0 ? masterSecret : credential->attribute[i - 1])); \
-  __code(PRIM, PRIM_MULTIPLY, SIZE_M); \
-  /* Put the result address in front of the operand (for STOREI) */\
-  __push(session.prove.mHat[i]); \
-  __code(PUSHZ, SIZE_M_); \
-  __code(ORN, SIZE_M_ + 2); \
-  __code(POPN, SIZE_M_ + 2); \
-  /* Add mTilde to the result of the multiplication and store in mHat*/\
-  __push(BLOCKCAST(SIZE_M_)(session.prove.mHat[i])); \
-  __code(ADDN, SIZE_M_); \
-  __code(POPN, SIZE_M_); \
-  __code(STOREI, SIZE_M_); \
-} while (0)
+#define crypto_compute_mHat(i, mHat) \
+  crypto_multiply_add(mHat, SIZE_M_, session.prove.challenge, SIZE_H, \
+    (i) == 0 ? masterSecret : credential->attribute[(i) - 1], SIZE_M, 0)
 
 /**
  * Determine whether an attribute is to be disclosed or not.
@@ -44,6 +44,7 @@
 #define INS_ISSUE_SIGNATURE_PROOF  0x1E
 
 #define INS_PROVE_CREDENTIAL       0x20
+#define INS_PROVE_REFILL           0x21
 
 #define INS_PROVE_COMMITMENT       0x2A
 #define INS_PROVE_SIGNATURE        0x2B
@@ -56,18 +57,34 @@
 
 #define INS_ADMIN_CREDENTIALS      0x3A
 #define INS_ADMIN_LOG              0x3B
+#define INS_ADMIN_DIRECTORY        0x3C
 
 #define P1_AUTHENTICATION_EXPONENT 0x00
 #define P1_AUTHENTICATION_MODULUS  0x01
+#define P1_AUTHENTICATION_ECC      0x02
 
 #define P1_PUBLIC_KEY_N 0x00
 #define P1_PUBLIC_KEY_S 0x01
 #define P1_PUBLIC_KEY_Z 0x02
 #define P1_PUBLIC_KEY_R 0x03
+#define P1_PUBLIC_KEY_BULK 0x04
+
+#define P1_PROVE_DEFAULT        0x00
+#define P1_PROVE_PRECOMPUTE     0x01
+
+#define P1_COMMITMENT_CHALLENGE 0x00
+#define P1_COMMITMENT_BULK      0x01
 
 #define P2_CRED_PIN             0x00
 #define P2_CARD_PIN             0x01
 
+#define P2_AUTHENTICATE_FULL    0x00
+#define P2_AUTHENTICATE_RESUME  0x01
+#define P2_AUTHENTICATE_ECDH    0x02
+
+#define P2_LOG_INDEX            0x00
+#define P2_LOG_SINCE            0x01
+
 #define P1_PROOF_VERIFY       0x00
 #define P1_PROOF_C            0x01
 #define P1_PROOF_VPRIMEHAT    0x02
@@ -81,6 +98,9 @@
 
 
 #define wrapped ((CLA & 0x0C) != 0)
+#define chained ((CLA & 0x10) != 0)
+#define bulkUpload ((CLA & 0xE3) == CLA_IRMACARD && \
+  INS == INS_ISSUE_PUBLIC_KEY && P1 == P1_PUBLIC_KEY_BULK)
 
 #define ReturnSW(sw) {\
   SetSW((sw)); \
@@ -31,18 +31,39 @@ extern Credential *credential;
 extern Byte flags;
 extern Byte flag;
 
-// Idemix: master secret
+// Issuance: parts of the signature staged in this session
+extern Byte staged;
+
+// Idemix: credentials and their index
+extern Credential credentials[MAX_CRED];
+extern CredentialIndex credentialIndex;
+
+// Idemix: journal of the credential which is being issued
+extern Credential *pending;
+
+// Idemix: issuer keys and master secret
+extern IssuerKey issuerKeys[MAX_KEY];
 extern CLMessage masterSecret;
 
+// The issuer key of the current credential
+#define issuerKey (issuerKeys[credential->issuer].key)
+
 // Secure messaging: send sequence counter and session keys
 extern Byte ssc[SIZE_SSC];
 extern Byte key_enc[SIZE_KEY];
 extern Byte key_mac[SIZE_KEY];
+extern Byte cipher;
+
+// Secure messaging: resumption ticket
+extern Ticket ticket;
 
 // Card authentication: private key and modulus
 extern Byte rsaExponent[SIZE_RSA_EXPONENT];
 extern Byte rsaModulus[SIZE_RSA_MODULUS];
 
+// Card authentication: ECC private key
+extern Byte eccKey[SIZE_ECC];
+
 // Secure messaging: initialisation vector
 extern Byte iv[SIZE_IV];
 
@@ -50,6 +71,9 @@ extern Byte iv[SIZE_IV];
 extern PIN cardPIN;
 extern PIN credPIN;
 
+// Proving: pool of precomputed proof commitments
+extern ProofCommitment pool[SIZE_POOL];
+
 // Logging
 extern LogEntry *log;
 
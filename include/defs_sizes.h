@@ -22,16 +22,34 @@
 
 // Attribute and credential definitions
 #define MAX_ATTR      5
-#define MAX_CRED      8
+#ifndef MAX_CRED
+#define MAX_CRED      8 // at most 127, such that all identifiers fit in a short response
+#endif // MAX_CRED
+#define MAX_KEY       4
 
-// System parameter lengths
+// System parameter profile, selected at build time by -DLENGTH_N=1024|2048
+#ifndef LENGTH_N
 #define LENGTH_N      1024
+#endif // LENGTH_N
+
+// System parameter lengths
+#if LENGTH_N == 1024
 #define LENGTH_M       256
 #define LENGTH_STATZK   80
 #define LENGTH_H       256 // SHA-256
 #define LENGTH_V      1700 // > L_N(1024) + L_STATZK(80) + L_H(256) + L_M(256) + 83
 #define LENGTH_E       597 // > L_STATZK(80) + L_H(256) + L_M(256) + 4
 #define LENGTH_EPRIME  120
+#elif LENGTH_N == 2048
+#define LENGTH_M       256
+#define LENGTH_STATZK  128
+#define LENGTH_H       256 // SHA-256
+#define LENGTH_V      2820 // > L_E(645) + L_R_A(2176) - 13, such that v' = v - e*r_A stays positive
+#define LENGTH_E       645 // > L_STATZK(128) + L_H(256) + L_M(256) + 4
+#define LENGTH_EPRIME  120
+#else
+#error LENGTH_N must be 1024 or 2048
+#endif // LENGTH_N
 #define LENGTH_VPRIME   (LENGTH_N + LENGTH_STATZK)
 #define LENGTH_VPRIME_  (LENGTH_N + 2*LENGTH_STATZK + LENGTH_H)
 #define LENGTH_V_       (LENGTH_V + LENGTH_STATZK + LENGTH_H)
@@ -40,32 +58,40 @@
 #define LENGTH_M_       (LENGTH_M + LENGTH_STATZK + LENGTH_H)
 #define LENGTH_E_       (LENGTH_EPRIME + LENGTH_STATZK + LENGTH_H)
 
-// Variable byte size definitions
-#define SIZE_L      MAX_ATTR + 1
-#define SIZE_N      128 // 1024 bits
-#define SIZE_M       32 //  256 bits
-#define SIZE_STATZK  10 //   80 bits
-#define SIZE_H       32 //  256 bits
-#define SIZE_V      213 // 1700 bits
-#define SIZE_E       75 //  597 bits
-#define SIZE_EPRIME  15 //  120 bits
-
-#define SIZE_VPRIME  (SIZE_N + SIZE_STATZK) // 138 bytes
-#define SIZE_VPRIME_ (SIZE_N + 2*SIZE_STATZK + SIZE_H) // 180 bytes
-#define SIZE_M_      (SIZE_M + SIZE_STATZK + SIZE_H) // 74 bytes
-#define SIZE_S_      (SIZE_M + SIZE_STATZK + SIZE_H + 1) // 75 bytes
-#define SIZE_R_A     (SIZE_N + SIZE_STATZK) // 138 bytes
-#define SIZE_V_      (SIZE_V + SIZE_STATZK + SIZE_H) // 255 bytes
-#define SIZE_E_      (SIZE_EPRIME + SIZE_STATZK + SIZE_H) // 57 bytes
-
-#define SIZE_BUFFER_C1 ((SIZE_H+3) + 2*(SIZE_N+4) + (SIZE_STATZK+3) + 3 + 4) // 319 bytes
-#define SIZE_BUFFER_C2 ((SIZE_H+3) + 3*(SIZE_N+4) + (SIZE_STATZK+3) + 3 + 4) // 450 bytes
+// Variable byte size definitions                  1024 / 2048
+#define SIZE_L      (MAX_ATTR + 1)
+#define SIZE_N      (LENGTH_N/8)              // 128 / 256 bytes
+#define SIZE_M      (LENGTH_M/8)              //  32 /  32 bytes
+#define SIZE_STATZK (LENGTH_STATZK/8)         //  10 /  16 bytes
+#define SIZE_H      (LENGTH_H/8)              //  32 /  32 bytes
+#define SIZE_V      ((LENGTH_V + 7)/8)        // 213 / 353 bytes
+#define SIZE_E      ((LENGTH_E + 7)/8)        //  75 /  81 bytes
+#define SIZE_EPRIME (LENGTH_EPRIME/8)         //  15 /  15 bytes
+
+#define SIZE_VPRIME  (SIZE_N + SIZE_STATZK) // 138 / 272 bytes
+#define SIZE_VPRIME_ (SIZE_N + 2*SIZE_STATZK + SIZE_H) // 180 / 320 bytes
+#define SIZE_M_      (SIZE_M + SIZE_STATZK + SIZE_H) // 74 / 80 bytes
+#define SIZE_S_      (SIZE_M + SIZE_STATZK + SIZE_H + 1) // 75 / 81 bytes
+#define SIZE_R_A     (SIZE_N + SIZE_STATZK) // 138 / 272 bytes
+#define SIZE_V_      (SIZE_V + SIZE_STATZK + SIZE_H) // 255 / 401 bytes
+#define SIZE_E_      (SIZE_EPRIME + SIZE_STATZK + SIZE_H) // 57 / 63 bytes
+
+// Size of a complete proof: c | A' | e^ | v^ | m^[i] (worst case)
+#define SIZE_PROOF   (SIZE_H + SIZE_N + SIZE_E_ + SIZE_V_ + SIZE_L*SIZE_M_) // 916 / 1232 bytes
+
+// Buffers for the ASN.1 DER encoding of the values hashed into c (round 1)
+// and c' (round 3), where each INTEGER takes a header of at most four bytes
+// and a sign byte
+#define SIZE_BUFFER_C1 ((SIZE_H+3) + 2*(SIZE_N+5) + (SIZE_STATZK+3) + 3 + 4) // 321 / 583 bytes
+#define SIZE_BUFFER_C2 ((SIZE_H+3) + 3*(SIZE_N+5) + (SIZE_STATZK+3) + 3 + 4) // 454 / 844 bytes
 
 // Auxiliary sizes
-#define SIZE_S_EXPONENT 128
+#define SIZE_S_EXPONENT SIZE_N // 128 / 256 bytes, every exponent with base S has at most twice this size
 #define SIZE_V_ADDITION 80
+#define SIZE_MUL_LIMB 127 // operand size of PRIM_MULTIPLY in crypto_multiply_add(), such that the product fits a single ADDN
 
 #define SIZE_IV 8
+#define SIZE_AES_BLOCK 16
 #define SIZE_SSC 8
 #define SIZE_MAC 8
 #define SIZE_KEY 16
@@ -74,17 +100,36 @@
 #define SIZE_KEY_SEED_TERMINAL 128
 #define SIZE_KEY_SEED (SIZE_KEY_SEED_CARD + SIZE_KEY_SEED_TERMINAL)
 
+#define SIZE_TICKET_ID 8
+#define SIZE_RESUME_NONCE 16
+#define LENGTH_RESUME_NONCE (SIZE_RESUME_NONCE*8)
+#define SIZE_RESUME_SEED (2*SIZE_RESUME_NONCE + SIZE_KEY)
+#define TICKET_USES 8 // resumptions before a full authentication is needed
+
 #define SIZE_RSA_EXPONENT 128
 #define SIZE_RSA_MODULUS 128
 
+#define SIZE_ECC 32 // P-256 coordinates and scalars
+#define SIZE_ECC_POINT (1 + 2*SIZE_ECC) // uncompressed: 0x04 | x | y
+#define SIZE_ECDH_NONCE 32
+#define LENGTH_ECDH_NONCE (SIZE_ECDH_NONCE*8)
+#define SIZE_ECDH_SEED (SIZE_ECDH_NONCE + SIZE_ECC)
+
 #define SIZE_PIN_MAX 8
 #define SIZE_CRED_PIN 4
 #define SIZE_CARD_PIN 6
 
+#define SIZE_SEED 32 // seed for the randomness rA, eTilde, vTilde and mTilde[i] of a proof
+#define SIZE_BATCH 2 // number of mTilde[i] derived at once for ZTilde
+#define SIZE_POOL 2
 #define SIZE_LOG 30
+#define SIZE_LOG_HEADER 3 // sequence number of the first entry and count
 #define SIZE_TERMINAL_ID 4
 #define SIZE_TIMESTAMP 4
 #define SIZE_FLAGS 2
+#define SIZE_FINGERPRINT 8 // truncated SHA-256 hash of the issuer modulus n
+#define SIZE_DIRECTORY_ENTRY (2 + 1 + 2*sizeof(CredentialFlags) + SIZE_FINGERPRINT) // id, size, flags, fingerprint (see defs_types.h)
+#define SIZE_DIRECTORY_HEADER 1 // slot at which the next page starts
 
 #ifdef ML2
 #ifdef ML3
@@ -22,9 +22,21 @@
 
 #include "defs_sizes.h"
 
+#ifdef EMULATOR
+#include <stddef.h> // for NULL
+#else // EMULATOR
 #define NULL 0x0000
+#endif // EMULATOR
 
+// The emulator lays out the structures as on the card: packed, big-endian
+// and with 16 bit integers
+#ifdef EMULATOR
+#pragma pack(push, 1)
+#pragma scalar_storage_order big-endian
+typedef unsigned short uint;
+#else // EMULATOR
 typedef unsigned int uint;
+#endif // EMULATOR
 typedef uint Size;
 typedef const char *String;
 
@@ -39,6 +51,12 @@ typedef Byte ResponseV[SIZE_V_];
 typedef Byte ResponseVPRIME[SIZE_VPRIME_];
 typedef Byte Number[SIZE_N];
 typedef Byte Counter[SIZE_SSC];
+
+typedef struct {
+  Byte id[SIZE_TICKET_ID];
+  Byte key[SIZE_KEY];
+  Byte uses; // remaining resumptions, zero if the ticket is invalid
+} Ticket;
 typedef Number Numbers[];
 
 typedef struct {
@@ -48,13 +66,30 @@ typedef struct {
 typedef Value *ValueArray;
 
 typedef struct {
+  ByteArray base;
+  ByteArray exponent;
+  Size size;
+} Power;
+typedef Power *PowerArray;
+
+typedef struct {
+  // The components n, Z, S and R[i] are stored consecutively, in the
+  // order in which they are uploaded (see KEY_N, KEY_Z, KEY_S, KEY_R)
   Number n;
   Number Z;
   Number S;
-  Number S_;
   Number R[SIZE_L];
+  Number S_; // S^(2^l) where l = SIZE_S_EXPONENT*8, see crypto_compute_S_()
 } CLPublicKey;
 
+typedef struct {
+  CLPublicKey key;
+  Byte loaded; // number of key components stored: n, Z, S, R[0], ...
+  Number secret; // R[0]^masterSecret mod n, kept as secret as masterSecret
+  Byte cached; // whether secret has been computed
+  Hash fingerprint; // SHA-256 hash of n, computed once n is stored
+} IssuerKey;
+
 typedef Byte CLMessage[SIZE_M];
 typedef CLMessage CLMessages[MAX_ATTR];
 
@@ -80,7 +115,7 @@ typedef struct {
 } CredentialFlags;
 
 typedef struct {
-  CLPublicKey issuerKey;
+  Byte issuer; // index of the issuer key in issuerKeys
   CLSignature signature;
   CLMessages attribute;
   CLProof proof;
@@ -90,6 +125,20 @@ typedef struct {
   CredentialIdentifier id;
 } Credential;
 
+typedef struct {
+  CredentialIdentifier id[MAX_CRED]; // identifier of the credential in each slot
+  Byte used[(MAX_CRED + 7) / 8]; // bitmap of the occupied slots
+} CredentialIndex;
+
+typedef struct {
+  Number APrime;
+  Byte seed[SIZE_SEED]; // for rA, eTilde, vTilde and mTilde[i]
+  Number ZTilde;
+  AttributeMask selection;
+  CredentialIdentifier id;
+  Byte valid;
+} ProofCommitment;
+
 typedef struct {
   Byte code[SIZE_PIN_MAX];
   Byte minSize;
@@ -110,9 +159,9 @@ typedef struct {
   } details;
 } LogEntry;
 
-#define ACTION_ISSUE 0x01;
-#define ACTION_PROVE 0x02;
-#define ACTION_REMOVE 0x03;
+#define ACTION_ISSUE 0x01
+#define ACTION_PROVE 0x02
+#define ACTION_REMOVE 0x03
 
 typedef union {
   Byte base[1];
@@ -133,19 +182,20 @@ typedef union {
   struct {
     union {
       Nonce nonce; // 10
-      Hash challenge; // 20
-    } apdu; // 20
+      Hash challenge; // 32
+    } apdu; // 32
     union {
-      Byte data[SIZE_BUFFER_C1]; // 319
+      Byte data[SIZE_V]; // 213
       Number number[2]; // 256
-    } buffer; // 319
-    Hash context; // 20
-    Value list[4]; // 16
-    Byte rA[SIZE_R_A]; // 138
-    Number APrime; // 128
-    ResponseV vHat; // 231
-    ResponseE eHat; // 45
-  } prove; // 20 + 307 + 20 + 16 + 138 + 128 + 231 + 45 = 905
+    } buffer; // 256
+    Power power[3 + SIZE_BATCH]; // 30
+    ResponseV vHat; // 255
+    ResponseE eHat; // 57
+  } prove; // 32 + 256 + 30 + 255 + 57 = 630 (2048 bits: 1038)
+
+  struct {
+    AttributeMask selection;
+  } poolSetup;
 
   struct {
     CredentialIdentifier id;
@@ -153,17 +203,20 @@ typedef union {
     Size size;
     CredentialFlags flags;
     Byte timestamp[SIZE_TIMESTAMP];
+    Hash fingerprint;
   } issuanceSetup;
 
   struct {
-    Number U; // 128
     union {
-      Byte data[SIZE_BUFFER_C1]; // 307
+      Byte data[SIZE_BUFFER_C1]; // 321
       Number number[3]; // 384
     } buffer; // 384
-    Value list[5]; // 20
+    union {
+      Value value[5]; // 20
+      Power power[3]; // 18
+    } list; // 20
     Nonce nonce; // 10
-  } issue; // 128 + 384 + 20 + 10 = 542
+  } issue; // 384 + 20 + 10 = 414
 
   struct {
     Number ZPrime; // 128
@@ -172,8 +225,11 @@ typedef union {
   } vfySig; // 384
 
   struct {
-    Byte buffer[SIZE_BUFFER_C2]; // 438
-  } vfyPrf; // 438
+    union {
+      Byte data[SIZE_BUFFER_C2]; // 454
+      Number number; // 128
+    } buffer; // 454
+  } vfyPrf; // 454
 
   struct {
     CredentialFlags user;
@@ -185,23 +241,45 @@ typedef union {
   Byte base[1];
 
   struct {
-    ResponseM mHat[SIZE_L]; // 74*6 (444)
+    Byte seed[SIZE_SEED]; // 32
+    ResponseM mTilde[SIZE_BATCH]; // 74*2 (148)
+    Hash challenge; // 32
     AttributeMask disclose; // 2
-#ifdef SIMULATOR
-    // Store values to work around the simulator clearing public
     Hash context; // 32
     Number APrime; // 128
+    Number ZTilde; // 128
+    Value list[4]; // 16
+#ifdef SIMULATOR
+    // Store values to work around the simulator clearing public
     ResponseV vHat; // 255
     ResponseE eHat; // 57
 #endif // SIMULATOR
-  } prove; // 444 + 2 = 446 (444 + 2 + 32 + 128 + 255 + 57 = 918)
+  } prove; // 32 + 148 + 32 + 2 + 32 + 128 + 128 + 16 = 518 (518 + 255 + 57 = 830)
+
+  struct {
+    Hash challenge; // 32
+    Byte vPrime[SIZE_VPRIME]; // 138
+    Byte sTilde[SIZE_S_]; // 75
+    ResponseVPRIME vPrimeTilde; // 180
+    union {
+      // The commitment is only needed until the challenge has been hashed
+      struct {
+        Number U; // 128
+        Number UTilde; // 128
+      } commitment; // 128 + 128 = 256
+      struct {
+        Byte sHat[SIZE_S_]; // 75
+        ResponseVPRIME vPrimeHat; // 180
+      } response; // 75 + 180 = 255
+    } proof; // 256
+  } issue; // 32 + 138 + 75 + 180 + 256 = 681
 
   struct {
+    // Same initial members as issue, the signature overlays the commitment
     Hash challenge; // 32
-    Byte sHat[SIZE_S_]; // 75
     Byte vPrime[SIZE_VPRIME]; // 138
-    ResponseVPRIME vPrimeHat; // 180
-  } issue; // 32 + 75 + 138 + 180 = 425
+    CLSignature signature; // 416
+  } sign; // 32 + 138 + 416 = 586
 
   struct {
     Value list[5]; // 20
@@ -211,4 +289,9 @@ typedef union {
   } vfyPrf; // 20 + 32 + 128 + 128 = 308
 } SessionData;
 
+#ifdef EMULATOR
+#pragma scalar_storage_order default
+#pragma pack(pop)
+#endif // EMULATOR
+
 #endif // __defs_types_H
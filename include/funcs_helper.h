@@ -60,9 +60,46 @@ int asn1_encode_seq(int length, int size, ByteArray buffer, int offset);
  */
 void clear(int size, ByteArray buffer);
 
+/**
+ * Encode a log entry compactly, leaving out the unused details
+ *
+ *   timestamp | terminal | action | credential [| selection]
+ *
+ * @param entry to be encoded
+ * @param buffer to store the encoding
+ * @return the length of the encoding
+ */
+int log_encode_entry(LogEntry *entry, ByteArray buffer);
+
+/**
+ * Lookup the slot of the credential with the given identifier
+ *
+ * @param id of the credential
+ * @return the slot of the credential, or MAX_CRED if it does not exist
+ */
+Byte credential_lookup(CredentialIdentifier id);
+
+/**
+ * Find a free credential slot
+ *
+ * @return a free slot, or MAX_CRED if all slots are occupied
+ */
+Byte credential_allocate(void);
+
+/**
+ * Enter the current credential into the index, occupying its slot
+ */
+void credential_index(void);
+
+/**
+ * Remove the current credential from the index, freeing its slot
+ */
+void credential_unindex(void);
+
 #define log_new_entry() \
   log = &logList[logHead]; \
-  logHead = (logHead + 1) % SIZE_LOG;
+  logHead = (logHead + 1) % SIZE_LOG; \
+  logSequence++;
 // FIXME: CLEAR this log entry.
 
 #define log_get_entry(index) \
@@ -20,6 +20,7 @@
 #include "crypto_helper.h"
 
 #include <multosarith.h>
+#include <multosccr.h> // for CFlag()
 #include <multoscrypto.h>
 #include <string.h>
 
@@ -42,6 +43,26 @@
 // Shared functions                                                 //
 //////////////////////////////////////////////////////////////////////
 
+// Domain parameters of the NIST P-256 curve in the prime field format of
+// the MULTOS ECC primitives: 0x00 | size | p | a | b | G | n | h
+const Byte eccDomain[] = {
+  0x00, SIZE_ECC,
+  0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+  0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFC,
+  0x5A, 0xC6, 0x35, 0xD8, 0xAA, 0x3A, 0x93, 0xE7, 0xB3, 0xEB, 0xBD, 0x55, 0x76, 0x98, 0x86, 0xBC,
+  0x65, 0x1D, 0x06, 0xB0, 0xCC, 0x53, 0xB0, 0xF6, 0x3B, 0xCE, 0x3C, 0x3E, 0x27, 0xD2, 0x60, 0x4B,
+  0x04,
+  0x6B, 0x17, 0xD1, 0xF2, 0xE1, 0x2C, 0x42, 0x47, 0xF8, 0xBC, 0xE6, 0xE5, 0x63, 0xA4, 0x40, 0xF2,
+  0x77, 0x03, 0x7D, 0x81, 0x2D, 0xEB, 0x33, 0xA0, 0xF4, 0xA1, 0x39, 0x45, 0xD8, 0x98, 0xC2, 0x96,
+  0x4F, 0xE3, 0x42, 0xE2, 0xFE, 0x1A, 0x7F, 0x9B, 0x8E, 0xE7, 0xEB, 0x4A, 0x7C, 0x0F, 0x9E, 0x16,
+  0x2B, 0xCE, 0x33, 0x57, 0x6B, 0x31, 0x5E, 0xCE, 0xCB, 0xB6, 0x40, 0x68, 0x37, 0xBF, 0x51, 0xF5,
+  0xFF, 0xFF, 0xFF, 0xFF, 0x00, 0x00, 0x00, 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+  0xBC, 0xE6, 0xFA, 0xAD, 0xA7, 0x17, 0x9E, 0x84, 0xF3, 0xB9, 0xCA, 0xC2, 0xFC, 0x63, 0x25, 0x51,
+  0x01
+};
+
 /**
  * Compute a cryptographic hash of the given input values
  *
@@ -53,6 +74,7 @@
  */
 void crypto_compute_hash(ValueArray list, int length, ByteArray result,
                          ByteArray buffer, int size) {
+  Byte count[2];
   int i, offset = size;
 
   // Store the values
@@ -61,7 +83,9 @@ void crypto_compute_hash(ValueArray list, int length, ByteArray result,
   }
 
   // Store the number of values in the sequence
-  offset = asn1_encode_int((ByteArray) &length, 2, buffer, offset);
+  count[0] = (Byte) (length >> 8);
+  count[1] = (Byte) length;
+  offset = asn1_encode_int(count, 2, buffer, offset);
 
   // Finalise the sequence
   offset = asn1_encode_seq(size - offset, length, buffer, offset);
@@ -92,9 +116,13 @@ void crypto_generate_random(ByteArray buffer, int length) {
   // Generate the random number in blocks of eight bytes (64 bits)
   while (length >= 64) {
     buffer -= 8;
+#ifndef EMULATOR
     __push(buffer);
     __code(PRIM, PRIM_RANDOM);
     __code(STOREI, 8);
+#else // EMULATOR
+    GetRandomNumber(buffer);
+#endif // EMULATOR
     length -= 64;
   }
 
@@ -156,6 +184,171 @@ void crypto_generate_random(ByteArray buffer, int length) {
 #endif // TEST
 }
 
+/**
+ * Derive a pseudo-random number of length bits from a seed
+ *
+ * The number is expanded in counter mode: block j of the output is
+ * H(seed | index | j), such that the same number can be regenerated
+ * from the seed whenever it is needed.
+ *
+ * @param seed of SIZE_SEED bytes to derive the number from
+ * @param index of the number to derive from the seed
+ * @param buffer to store the derived number
+ * @param length in bits of the number to derive
+ */
+void crypto_derive_random(ByteArray seed, Byte index, ByteArray buffer, int length) {
+  Byte input[SIZE_SEED + 2];
+  Hash block;
+  int size = (length + 7) / 8, n;
+#ifdef SHA1_PADDED
+  int i;
+#endif // SHA1_PADDED
+
+  memcpy(input, seed, SIZE_SEED);
+  input[SIZE_SEED] = index;
+  input[SIZE_SEED + 1] = 0;
+
+  // Fill the buffer from the least significant end, a block at a time
+  while (size > 0) {
+#ifndef SHA1_PADDED
+    SHA256(SIZE_SEED + 2, block, input);
+#else // SHA1_PADDED
+    for (i = 0; i < SIZE_H; i++) {
+      block[i] = i;
+    }
+    SHA1(SIZE_SEED + 2, block, input);
+#endif // SHA1_PADDED
+    n = (size < SIZE_H) ? size : SIZE_H;
+    size -= n;
+    memcpy(buffer + size, block + SIZE_H - n, n);
+    input[SIZE_SEED + 1]++;
+  }
+
+  buffer[0] &= 0xFF >> ((8 - length % 8) % 8);
+  crypto_clear(SIZE_SEED, input);
+  crypto_clear(SIZE_H, block);
+}
+
+/**
+ * Accumulate a product into the result: result = result +/- z
+ *
+ * The product z is added at the given offset, which is where its least
+ * significant byte ends up, after which the carry (or borrow) is propagated
+ * towards the start of the result as a zero padded one, a block at a time.
+ * Any part of z before the start of the result is discarded.
+ *
+ * @param result to accumulate the product into
+ * @param offset at which the product ends in the result
+ * @param z product of size 2*SIZE_MUL_LIMB
+ * @param window scratch buffer of size 2*SIZE_MUL_LIMB
+ * @param subtract whether to subtract the product instead of adding it
+ */
+static void crypto_accumulate(ByteArray result, int offset, ByteArray z,
+                              ByteArray window, Byte subtract) {
+#ifndef EMULATOR
+  ByteArray dest;
+  Byte carry = 0;
+
+  do {
+    dest = result + offset - 2*SIZE_MUL_LIMB;
+
+    // Use a zero padded window if the block extends before the result
+    if (offset < 2*SIZE_MUL_LIMB) {
+      memset(window, 0x00, 2*SIZE_MUL_LIMB - offset);
+      memcpy(window + 2*SIZE_MUL_LIMB - offset, result, offset);
+      dest = window;
+    }
+
+    __push(dest);
+    __push(BLOCKCAST(2*SIZE_MUL_LIMB)(dest));
+    if (carry == 0) {
+      __push(BLOCKCAST(2*SIZE_MUL_LIMB)(z));
+    } else {
+      __code(PUSHZ, 2*SIZE_MUL_LIMB - 1);
+      __code(PUSHB, 1);
+    }
+    if (subtract != 0) {
+      __code(SUBN, 2*SIZE_MUL_LIMB);
+    } else {
+      __code(ADDN, 2*SIZE_MUL_LIMB);
+    }
+    __code(POPN, 2*SIZE_MUL_LIMB);
+    __code(STOREI, 2*SIZE_MUL_LIMB);
+    CFlag(&carry);
+
+    if (offset < 2*SIZE_MUL_LIMB) {
+      memcpy(result, window + 2*SIZE_MUL_LIMB - offset, offset);
+    }
+    offset -= 2*SIZE_MUL_LIMB;
+  } while (offset > 0 && carry != 0);
+#else // EMULATOR
+  int k, t, carry = 0;
+
+  for (k = 2*SIZE_MUL_LIMB - 1; offset > 0 && (k >= 0 || carry != 0); k--) {
+    offset--;
+    t = (k >= 0) ? z[k] + carry : carry;
+    t = (subtract != 0) ? result[offset] - t : result[offset] + t;
+    result[offset] = (Byte) t;
+    carry = (t < 0 || t > 0xFF) ? 1 : 0;
+  }
+#endif // EMULATOR
+}
+
+/**
+ * Compute the multiply-accumulate: result = result +/- a*b
+ *
+ * The operands are split into limbs of SIZE_MUL_LIMB bytes, which are
+ * multiplied by the PRIM_MULTIPLY primitive (schoolbook) and accumulated
+ * into the result with carry (or borrow) propagation. Any part of the
+ * product beyond the size of the result is discarded.
+ *
+ * @param result to accumulate the product into
+ * @param size of the result
+ * @param a first operand
+ * @param sizeA of the first operand
+ * @param b second operand
+ * @param sizeB of the second operand
+ * @param subtract whether to subtract the product instead of adding it
+ */
+void crypto_multiply_add(ByteArray result, int size, ByteArray a, int sizeA,
+                         ByteArray b, int sizeB, Byte subtract) {
+  // The limbs x and y share a buffer, which serves as window once multiplied
+  Byte xy[2*SIZE_MUL_LIMB], z[2*SIZE_MUL_LIMB];
+  ByteArray x = xy, y = xy + SIZE_MUL_LIMB;
+  int i, j, n, offset;
+
+  for (i = sizeA; i > 0; i -= SIZE_MUL_LIMB) {
+    for (j = sizeB; j > 0; j -= SIZE_MUL_LIMB) {
+      // Load the limbs of a and b ending at i and j, padded with zero bytes
+      n = (i < SIZE_MUL_LIMB) ? i : SIZE_MUL_LIMB;
+      memset(x, 0x00, SIZE_MUL_LIMB - n);
+      memcpy(x + SIZE_MUL_LIMB - n, a + i - n, n);
+      n = (j < SIZE_MUL_LIMB) ? j : SIZE_MUL_LIMB;
+      memset(y, 0x00, SIZE_MUL_LIMB - n);
+      memcpy(y + SIZE_MUL_LIMB - n, b + j - n, n);
+
+      // Compute z = x * y
+#ifndef EMULATOR
+      __push(BLOCKCAST(SIZE_MUL_LIMB)(x));
+      __push(BLOCKCAST(SIZE_MUL_LIMB)(y));
+      __code(PRIM, PRIM_MULTIPLY, SIZE_MUL_LIMB);
+      __code(STORE, z, 2*SIZE_MUL_LIMB);
+#else // EMULATOR
+      multos_multiply(SIZE_MUL_LIMB, x, y, z);
+#endif // EMULATOR
+
+      // Accumulate z into the result at the weight of the limbs
+      offset = size - (sizeA - i) - (sizeB - j);
+      if (offset > 0) {
+        crypto_accumulate(result, offset, z, xy, subtract);
+      }
+    }
+  }
+
+  crypto_clear(2*SIZE_MUL_LIMB, xy);
+  crypto_clear(2*SIZE_MUL_LIMB, z);
+}
+
 /**
  * Compute the helper value S' = S^(2_l) where l = SIZE_S_EXPONENT*8
  *
@@ -168,9 +361,8 @@ void crypto_compute_S_(void) {
 
   // Compute S_ = S^(2_l)
   crypto_modexp(SIZE_S_EXPONENT, SIZE_N, public.issue.buffer.data,
-    credential->issuerKey.n, credential->issuerKey.S, credential->issuerKey.S_);
-  crypto_modmul(SIZE_N, credential->issuerKey.S_, credential->issuerKey.S, 
-    credential->issuerKey.n);
+    issuerKey.n, issuerKey.S, issuerKey.S_);
+  crypto_modmul(SIZE_N, issuerKey.S_, issuerKey.S, issuerKey.n);
 }
 
 /**
@@ -182,19 +374,55 @@ void crypto_compute_S_(void) {
  * @param size of the exponent
  * @param exponent the power to which the base S should be raised
  * @param result of the computation
+ * @param buffer for temporary storage of SIZE_N bytes
  */
 void crypto_modexp_special(int size, ByteArray exponent, ByteArray result, ByteArray buffer) {
-  if (size > SIZE_N) {
+  if (size > SIZE_S_EXPONENT) {
     // Compute result = S^(exponent_bottom) * S_^(exponent_top)
     crypto_modexp(SIZE_S_EXPONENT, SIZE_N, exponent + size - SIZE_S_EXPONENT,
-      credential->issuerKey.n, credential->issuerKey.S, result);
+      issuerKey.n, issuerKey.S, result);
     crypto_modexp(size - SIZE_S_EXPONENT, SIZE_N,
-      exponent, credential->issuerKey.n, credential->issuerKey.S_, buffer);
-    crypto_modmul(SIZE_N, result, buffer, credential->issuerKey.n);
+      exponent, issuerKey.n, issuerKey.S_, buffer);
+    crypto_modmul(SIZE_N, result, buffer, issuerKey.n);
   } else {
     // Compute result = S^exponent
     crypto_modexp(size, SIZE_N,
-      exponent, credential->issuerKey.n, credential->issuerKey.S, result);
+      exponent, issuerKey.n, issuerKey.S, result);
+  }
+}
+
+/**
+ * Compute the product of modular exponentiations:
+ *   result = base[0]^exponent[0] * ... * base[count-1]^exponent[count-1] mod n
+ *
+ * Every power is computed by the modular exponentiation primitive (which
+ * is done in hardware), after which the powers are multiplied. An
+ * interleaved software squaring chain would need one interpreted modular
+ * multiplication per bit instead.
+ *
+ * @param list of powers (base, exponent, size) to be multiplied
+ * @param count of the powers in the list
+ * @param modulus for the computation
+ * @param result of the computation
+ * @param buffer for temporary storage of SIZE_N bytes
+ */
+void crypto_modexp_product(PowerArray list, int count, ByteArray modulus,
+                         ByteArray result, ByteArray buffer) {
+  int i;
+
+  // An empty product is one
+  if (count == 0) {
+    memset(result, 0x00, SIZE_N);
+    result[SIZE_N - 1] = 0x01;
+    return;
+  }
+
+  crypto_modexp(list[0].size, SIZE_N, list[0].exponent, modulus,
+    list[0].base, result);
+  for (i = 1; i < count; i++) {
+    crypto_modexp(list[i].size, SIZE_N, list[i].exponent, modulus,
+      list[i].base, buffer);
+    crypto_modmul(SIZE_N, result, buffer, modulus);
   }
 }
 
@@ -205,6 +433,7 @@ void crypto_modexp_special(int size, ByteArray exponent, ByteArray result, ByteA
  * @param buffer to be cleared
  */
 void crypto_clear(int size, ByteArray buffer) {
+#ifndef EMULATOR
   while (size > 255) {
     __push(buffer);
     __code(PUSHZ, 255);
@@ -212,6 +441,7 @@ void crypto_clear(int size, ByteArray buffer) {
     buffer += 255;
     size -= 255;
   }
+#endif // EMULATOR
   memset(buffer, 0x00, size);
 }
 
@@ -219,6 +449,7 @@ void crypto_clear(int size, ByteArray buffer) {
  * Clear the current credential.
  */
 void crypto_clear_credential(void) {
+#ifndef EMULATOR
   Byte i;
 
   // Put the address of the credential on the stack
@@ -243,6 +474,9 @@ void crypto_clear_credential(void) {
 
   // Remove the address from the stack
   __code(POPN, 2);
+#else // EMULATOR
+  memset(credential, 0x00, sizeof(Credential));
+#endif // EMULATOR
 
   // Clear the pointer to the credential
   credential = NULL;
@@ -252,10 +486,6 @@ void crypto_clear_credential(void) {
  * Clear the current session.
  */
 void crypto_clear_session(void) {
-  CLEARN(255, session.base);
-  CLEARN(sizeof(SessionData) % 255, session.base + 255);
-  CLEARN(255, public.base);
-  CLEARN(255, public.base + 255);
-  CLEARN(255, public.base + 255*2);
-  CLEARN(sizeof(PublicData) % 255, public.base + 255*3);
+  crypto_clear(sizeof(SessionData), session.base);
+  crypto_clear(sizeof(PublicData), public.base);
 }
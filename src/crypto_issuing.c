@@ -30,107 +30,358 @@
 #include "defs_sizes.h"
 #include "defs_types.h"
 #include "funcs_debug.h"
+#include "funcs_helper.h"
 #include "crypto_helper.h"
 #include "crypto_multos.h"
+#include "crypto_proving.h"
 
 /********************************************************************/
 /* Issuing functions                                                */
 /********************************************************************/
 
 /**
- * Construct a commitment (round 1)
+ * Find the issuer key for a new credential.
+ *
+ * A stored key of which the fingerprint, as computed by the card once n
+ * was stored, matches the given one is shared with the new credential,
+ * otherwise a free entry is used for a new key.
+ *
+ * @param fingerprint of the issuer key, or NULL if it should not be shared
+ * @return index of the key in issuerKeys, or MAX_KEY if none is available
+ */
+Byte findIssuerKey(ByteArray fingerprint) {
+  Byte k;
+
+  if (fingerprint != NULL) {
+    for (k = 0; k < MAX_KEY; k++) {
+      if (countIssuerKeyUsers(k) != 0 && issuerKeys[k].loaded > KEY_N &&
+          memcmp(issuerKeys[k].fingerprint, fingerprint, SIZE_H) == 0) {
+        debugInteger("Sharing issuer key", k);
+        return k;
+      }
+    }
+  }
+
+  for (k = 0; k < MAX_KEY && countIssuerKeyUsers(k) != 0; k++);
+  return k;
+}
+
+/**
+ * Count the credentials which use issuer key k.
+ *
+ * The users are derived from the credential index rather than kept in a
+ * counter, such that a credential stops using its key in the single
+ * write which removes it from the index.
+ *
+ * @param k index of the key in issuerKeys
+ * @return number of indexed credentials which use the key
+ */
+Byte countIssuerKeyUsers(Byte k) {
+  Byte i, users = 0;
+
+  for (i = 0; i < MAX_CRED; i++) {
+    if ((credentialIndex.used[i / 8] & (1 << (i % 8))) != 0 &&
+        credentials[i].issuer == k) {
+      users++;
+    }
+  }
+  return users;
+}
+
+/**
+ * Release the issuer key of the current credential.
+ *
+ * The key is erased once no credential uses it anymore, so the current
+ * credential should have been removed from the index. Releasing a key
+ * again has no effect, such that an interrupted removal can be redone.
+ */
+void releaseIssuerKey(void) {
+  if (countIssuerKeyUsers(credential->issuer) == 0) {
+    crypto_clear(sizeof(IssuerKey), (ByteArray) &issuerKeys[credential->issuer]);
+  }
+}
+
+/**
+ * Complete the issuer key component j once it has been stored.
+ *
+ * Computes the fingerprint of n and the helper value S_,
+ * and invalidates the precomputed commitment and the cached R[0]^ms if
+ * they depend on the component.
+ *
+ * @param j index of the component (KEY_N, KEY_Z, KEY_S or KEY_R + i)
+ */
+void completeIssuerKey(Byte j) {
+  debugNumber("Initialised issuer key component", issuerKey.n + j*SIZE_N);
+
+  if (j == KEY_N) {
+    SHA256(SIZE_N, issuerKeys[credential->issuer].fingerprint, issuerKey.n);
+    debugHash("Initialised issuer key fingerprint", issuerKeys[credential->issuer].fingerprint);
+  } else if (j == KEY_S) {
+    crypto_compute_S_();
+    debugNumber("Initialised issuerKey.S_", issuerKey.S_);
+  }
+
+  // U and UTilde depend on n, S and R[0]
+  if (j != KEY_Z && j <= KEY_R) {
+    flags &= ~FLAG_ISSUE_PRECOMPUTED;
+  }
+
+  // R[0]^ms depends on n and R[0]
+  if (j == KEY_N || j == KEY_R) {
+    issuerKeys[credential->issuer].cached = 0;
+  }
+
+  issuerKeys[credential->issuer].loaded++;
+}
+
+/**
+ * Store a segment of a bulk upload of the issuer key and attributes
+ *
+ * The upload is the concatenation of the key components n, Z, S, R[0],
+ * ..., R[l] and the attributes m[1], ..., m[l], and may be split at any
+ * byte over a chain of commands. Key components which are already
+ * present (possibly shared) are compared rather than stored. Completing
+ * the key components is left to the caller, since the fixed-base table
+ * reuses the APDU buffer.
+ *
+ * @param offset of the segment in the upload
+ * @param data of the segment
+ * @param length of the segment
+ * @return the offset in the upload following the segment
+ */
+int storeBulk(int offset, ByteArray data, int length) {
+  int size, keySize = (KEY_R + 1 + credential->size)*SIZE_N;
+
+  // Store (or compare) the key components
+  while (length > 0 && offset < keySize) {
+    size = SIZE_N - offset % SIZE_N;
+    if (size > length) {
+      size = length;
+    }
+    if (offset / SIZE_N < issuerKeys[credential->issuer].loaded) {
+      if (memcmp(issuerKey.n + offset, data, size) != 0) {
+        debugWarning("Issuer key component differs from the stored one");
+        flags &= ~FLAG_ISSUE_BULK;
+        ReturnSW(ISO7816_SW_COMMAND_NOT_ALLOWED);
+      }
+    } else {
+      memcpy(issuerKey.n + offset, data, size);
+    }
+    offset += size;
+    data += size;
+    length -= size;
+  }
+
+  // Store the attributes
+  if (length > 0) {
+    memcpy(credential->attribute[0] + offset - keySize, data, length);
+    offset += length;
+  }
+
+  return offset;
+}
+
+/**
+ * Remove the current credential.
+ *
+ * Drops its precomputed proof commitments and its reference to the
+ * issuer key before the credential itself is erased. Every step may be
+ * repeated, such that an interrupted removal is completed later on.
+ */
+void removeCredential(void) {
+  dropProofCommitments(credential->id);
+  credential_unindex();
+  releaseIssuerKey();
+  crypto_clear_credential();
+}
+
+/**
+ * Roll back the issuance of the pending credential.
+ *
+ * The journal is only cleared once the credential has been erased, such
+ * that an interrupted roll back is completed later on.
+ */
+void abortIssuance(void) {
+  debugWarning("Rolling back the pending issuance");
+  credential = pending;
+  removeCredential();
+  pending = NULL;
+  flags &= ~(FLAG_ISSUE_PRECOMPUTED | FLAG_ISSUE_COMMITTED | FLAG_ISSUE_SIGNED);
+}
+
+/**
+ * Compute R[0]^m[0] mod n, or take it from the issuer key if cached.
+ *
+ * The (slow) secure exponentiation is done once per issuer key, after
+ * which the result is stored next to the key in static memory.
+ *
+ * @param issuerKey (R[0], n)
+ * @param masterSecret
+ * @param result of SIZE_N bytes
+ */
+void computeMasterPower(ByteArray result) {
+  IssuerKey *key = &issuerKeys[credential->issuer];
+
+  if (!key->cached) {
+    crypto_modexp_secure(SIZE_M, SIZE_N, masterSecret, key->key.n,
+      key->key.R[0], result);
+    memcpy(key->secret, result, SIZE_N);
+    key->cached = 1;
+  } else {
+    memcpy(result, key->secret, SIZE_N);
+  }
+}
+
+/**
+ * Precompute the nonce independent part of the commitment (round 1)
+ *
+ *   U = S^vPrime * R[0]^m[0], UTilde = S^vPrimeTilde * R[0]^sTilde
  *
  * @param issuerKey (S, R, n)
- * @param proof (nonce, context)
  * @param masterSecret
- * @param number for U
- * @param number for UTilde
- * @param vPrime in signature.v + SIZE_V - SIZE_VPRIME
- * @param vPrimeTilde in vHat
- * @param vPrimeHat in vHat
- * @param mTilde[0] in mHat[0]
- * @param s_A in mHat[0]
- * @param nonce
- * @param buffer for hash of SIZE_BUFFER_C1
- * @param (buffer for SpecialModularExponentiation of SIZE_N)
+ * @param U in session.issue.proof.commitment.U
+ * @param UTilde in session.issue.proof.commitment.UTilde
+ * @param vPrime in session.issue.vPrime
+ * @param vPrimeTilde in session.issue.vPrimeTilde
+ * @param sTilde in session.issue.sTilde
+ * @param (buffer for SpecialModularExponentiation of 2*SIZE_N)
  */
-void constructCommitment(void) {
+void precomputeCommitment(void) {
+  // The commitment overwrites the responses of any previous one, as
+  // well as the staged signature
+  flags &= ~FLAG_ISSUE_COMMITTED;
+  staged = 0;
 
   // Generate random vPrime
   crypto_generate_random(session.issue.vPrime, LENGTH_VPRIME);
   debugValue("vPrime", session.issue.vPrime, SIZE_VPRIME);
 
   // Compute U = S^vPrime * R[0]^m[0] mod n
-  crypto_modexp_special(SIZE_VPRIME, session.issue.vPrime, public.issue.U,
+  crypto_modexp_special(SIZE_VPRIME, session.issue.vPrime, session.issue.proof.commitment.U,
     public.issue.buffer.number[0]);
-  debugNumber("U = S^vPrime mod n", public.issue.U);
-  crypto_modexp_secure(SIZE_M, SIZE_N, masterSecret, credential->issuerKey.n,
-    credential->issuerKey.R[0], public.issue.buffer.number[0]);
+  debugNumber("U = S^vPrime mod n", session.issue.proof.commitment.U);
+  computeMasterPower(public.issue.buffer.number[0]);
   debugNumber("buffer = R[0]^m[0] mod n", public.issue.buffer.number[0]);
-  crypto_modmul(SIZE_N, public.issue.U, public.issue.buffer.number[0],
-    credential->issuerKey.n);
-  debugNumber("U = U * buffer mod n", public.issue.U);
+  crypto_modmul(SIZE_N, session.issue.proof.commitment.U, public.issue.buffer.number[0],
+    issuerKey.n);
+  debugNumber("U = U * buffer mod n", session.issue.proof.commitment.U);
 
   // Compute P1:
   // - Generate random vPrimeTilde, mTilde[0]
-  crypto_generate_random(session.issue.vPrimeHat, LENGTH_VPRIME_);
-  debugValue("vPrimeTilde", session.issue.vPrimeHat, SIZE_VPRIME_);
-  crypto_generate_random(session.issue.sHat, LENGTH_S_);
-  debugValue("sTilde", session.issue.sHat, SIZE_S_);
+  crypto_generate_random(session.issue.vPrimeTilde, LENGTH_VPRIME_);
+  debugValue("vPrimeTilde", session.issue.vPrimeTilde, SIZE_VPRIME_);
+  crypto_generate_random(session.issue.sTilde, LENGTH_S_);
+  debugValue("sTilde", session.issue.sTilde, SIZE_S_);
 
   // - Compute UTilde = S^vPrimeTilde * R[0]^sTilde mod n
-  crypto_modexp_special(SIZE_VPRIME_, session.issue.vPrimeHat,
-    public.issue.buffer.number[0], public.issue.buffer.number[1]);
-  debugNumber("UTilde = S^vPrimeTilde mod n", public.issue.buffer.number[0]);
-  crypto_modexp(SIZE_S_, SIZE_N, session.issue.sHat, credential->issuerKey.n,
-    credential->issuerKey.R[0], public.issue.buffer.number[1]);
-  debugNumber("buffer = R[0]^sTilde mod n", public.issue.buffer.number[1]);
-  crypto_modmul(SIZE_N, public.issue.buffer.number[0],
-    public.issue.buffer.number[1], credential->issuerKey.n);
-  debugNumber("UTilde = UTilde * buffer mod n", public.issue.buffer.number[0]);
+  //   where S^vPrimeTilde = S^(vPrimeTilde_bottom) * S_^(vPrimeTilde_top)
+  public.issue.list.power[0].base = issuerKey.S;
+  public.issue.list.power[0].exponent = session.issue.vPrimeTilde + SIZE_VPRIME_ - SIZE_S_EXPONENT;
+  public.issue.list.power[0].size = SIZE_S_EXPONENT;
+  public.issue.list.power[1].base = issuerKey.S_;
+  public.issue.list.power[1].exponent = session.issue.vPrimeTilde;
+  public.issue.list.power[1].size = SIZE_VPRIME_ - SIZE_S_EXPONENT;
+  public.issue.list.power[2].base = issuerKey.R[0];
+  public.issue.list.power[2].exponent = session.issue.sTilde;
+  public.issue.list.power[2].size = SIZE_S_;
+  crypto_modexp_product(public.issue.list.power, 3, issuerKey.n,
+    session.issue.proof.commitment.UTilde, public.issue.buffer.number[0]);
+  debugNumber("UTilde = S^vPrimeTilde * R[0]^sTilde mod n", session.issue.proof.commitment.UTilde);
+
+  flags |= FLAG_ISSUE_PRECOMPUTED;
+}
+
+/**
+ * Construct a commitment (round 1)
+ *
+ * Uses the precomputed U and UTilde if available, otherwise these are
+ * computed first. The randomness is kept apart from the responses, which
+ * overwrite U and UTilde once the challenge has been computed.
+ *
+ * @param proof (nonce, context)
+ * @param masterSecret
+ * @param U in session.issue.proof.commitment.U
+ * @param UTilde in session.issue.proof.commitment.UTilde
+ * @param vPrime in session.issue.vPrime
+ * @param vPrimeTilde in session.issue.vPrimeTilde
+ * @param vPrimeHat in session.issue.proof.response.vPrimeHat
+ * @param sTilde in session.issue.sTilde
+ * @param sHat in session.issue.proof.response.sHat
+ * @param nonce
+ * @param buffer for hash of SIZE_BUFFER_C1
+ */
+void constructCommitment(void) {
+
+  // Compute U and UTilde, unless this has already been done
+  if ((flags & FLAG_ISSUE_PRECOMPUTED) == 0) {
+    precomputeCommitment();
+  }
+
+  // The randomness for this commitment must never be used again
+  flags &= ~FLAG_ISSUE_PRECOMPUTED;
+
+  // The responses overwrite the staged signature, which has to be
+  // completed with the vPrime of this commitment
+  staged = STAGED_COMMITMENT;
 
   // - Compute challenge c = H(context | U | UTilde | nonce)
-  public.issue.list[0].data = credential->proof.context;
-  public.issue.list[0].size = SIZE_H;
-  public.issue.list[1].data = public.issue.U;
-  public.issue.list[1].size = SIZE_N;
-  public.issue.list[2].data = public.issue.buffer.number[0];
-  public.issue.list[2].size = SIZE_N;
-  public.issue.list[3].data = public.issue.nonce;
-  public.issue.list[3].size = SIZE_STATZK;
-  crypto_compute_hash(public.issue.list, 4, session.issue.challenge,
+  public.issue.list.value[0].data = credential->proof.context;
+  public.issue.list.value[0].size = SIZE_H;
+  public.issue.list.value[1].data = session.issue.proof.commitment.U;
+  public.issue.list.value[1].size = SIZE_N;
+  public.issue.list.value[2].data = session.issue.proof.commitment.UTilde;
+  public.issue.list.value[2].size = SIZE_N;
+  public.issue.list.value[3].data = public.issue.nonce;
+  public.issue.list.value[3].size = SIZE_STATZK;
+  crypto_compute_hash(public.issue.list.value, 4, session.issue.challenge,
     public.issue.buffer.data, SIZE_BUFFER_C1);
   debugHash("c", session.issue.challenge);
 
+  // Return U, the responses take its place
+  memcpy(public.apdu.data, session.issue.proof.commitment.U, SIZE_N);
+
   // - Compute response vPrimeHat = vPrimeTilde + c * vPrime
+  memcpy(session.issue.proof.response.vPrimeHat, session.issue.vPrimeTilde, SIZE_VPRIME_);
   crypto_compute_vPrimeHat();
-  debugValue("vPrimeHat", session.issue.vPrimeHat, SIZE_VPRIME_);
+  debugValue("vPrimeHat", session.issue.proof.response.vPrimeHat, SIZE_VPRIME_);
 
   // - Compute response sHat = sTilde + c * s
+  memcpy(session.issue.proof.response.sHat, session.issue.sTilde, SIZE_S_);
   crypto_compute_sHat();
-  debugValue("sHat", session.issue.sHat, SIZE_S_);
+  debugValue("sHat", session.issue.proof.response.sHat, SIZE_S_);
+
+  // The randomness is no longer needed
+  crypto_clear(SIZE_VPRIME_, session.issue.vPrimeTilde);
+  crypto_clear(SIZE_S_, session.issue.sTilde);
 
   // Generate random n_2
   crypto_generate_random(credential->proof.nonce, LENGTH_STATZK);
   debugNonce("nonce", credential->proof.nonce);
+
+  flags |= FLAG_ISSUE_COMMITTED;
 }
 
 /**
- * Construct the signature (round 3, part 1)
+ * Construct the signature (round 3, part 1) and commit the credential
  *
  *   A, e, v = v' + v''
  *
- * @param v' in session.issue.vPrime of size SIZE_VPRIME
+ * The signature is completed in session memory and stored in a single
+ * write, after which the credential is no longer pending.
+ *
+ * @param v' in session.sign.vPrime of size SIZE_VPRIME
  * @param v'' in public.apdu.data of size SIZE_V
+ * @param A, e in session.sign.signature
  * @param signature (A, e, v) in credential->signature
  */
 void constructSignature(void) {
 
   // Compute v = v' + v'' using add with carry
-  debugValue("v'", session.issue.vPrime, SIZE_VPRIME);
+  debugValue("v'", session.sign.vPrime, SIZE_VPRIME);
   debugValue("v''", public.apdu.data, SIZE_V);
-  __push(credential->signature.v + SIZE_V/2);
-  __push(BLOCKCAST(1 + SIZE_V/2)(session.issue.vPrime + SIZE_VPRIME - SIZE_V/2 - 1));
+#ifndef EMULATOR
+  __push(session.sign.signature.v + SIZE_V/2);
+  __push(BLOCKCAST(1 + SIZE_V/2)(session.sign.vPrime + SIZE_VPRIME - SIZE_V/2 - 1));
   __push(BLOCKCAST(1 + SIZE_V/2)(public.apdu.data + SIZE_V/2));
   __code(ADDN, 1 + SIZE_V/2);
   __code(POPN, 1 + SIZE_V/2);
@@ -143,14 +394,25 @@ void constructSignature(void) {
   }
 
   // First push some zero's to compensate for the size difference
-  __push(credential->signature.v);
+  __push(session.sign.signature.v);
   __code(PUSHZ, SIZE_V - SIZE_VPRIME);
-  __push(BLOCKCAST(SIZE_VPRIME - SIZE_V/2 - 1)(session.issue.vPrime));
+  __push(BLOCKCAST(SIZE_VPRIME - SIZE_V/2 - 1)(session.sign.vPrime));
   __push(BLOCKCAST(SIZE_V/2)(public.apdu.data));
   __code(ADDN, SIZE_V/2);
   __code(POPN, SIZE_V/2);
   __code(STOREI, SIZE_V/2);
-  debugValue("v = v' + v''", credential->signature.v, SIZE_V);
+#else // EMULATOR
+  memset(session.sign.signature.v, 0x00, SIZE_V - SIZE_VPRIME);
+  memcpy(session.sign.signature.v + SIZE_V - SIZE_VPRIME, session.sign.vPrime, SIZE_VPRIME);
+  ADDN(SIZE_V, session.sign.signature.v, public.apdu.data);
+#endif // EMULATOR
+  debugValue("v = v' + v''", session.sign.signature.v, SIZE_V);
+
+  // Store the signature and commit the credential
+  memcpy(&credential->signature, &session.sign.signature, sizeof(CLSignature));
+  staged = 0;
+  pending = NULL;
+  flags |= FLAG_ISSUE_SIGNED;
 }
 
 /**
@@ -159,23 +421,23 @@ void constructSignature(void) {
  *   Z =?= A^e * S^v * R where R = R[i]^m[i] forall i
  *
  * @param signature (A, e, v) in credential->signature
- * @param issuerKey (Z, S, R, n) in credential->issuerKey
+ * @param issuerKey (Z, S, R, n) in issuerKeys
  * @param attributes (m[0]...m[l]) in credential->attribute
  * @param masterSecret
+ * @param Q = A^e in session.vfyPrf.Q, if committed in this session
  */
 void verifySignature(void) {
   Byte i;
 
   // Compute Ri = R[i]^m[i] mod n forall i
-  crypto_modexp_secure(SIZE_M, SIZE_N, masterSecret, credential->issuerKey.n,
-    credential->issuerKey.R[0], public.vfySig.ZPrime);
+  computeMasterPower(public.vfySig.ZPrime);
   debugNumber("Z' = R[0]^ms mod n", public.vfySig.ZPrime);
   for (i = 1; i <= credential->size; ++i) {
-    crypto_modexp(SIZE_M, SIZE_N, credential->attribute[i - 1], credential->issuerKey.n,
-      credential->issuerKey.R[i], public.vfySig.buffer);
+    crypto_modexp(SIZE_M, SIZE_N, credential->attribute[i - 1], issuerKey.n,
+      issuerKey.R[i], public.vfySig.buffer);
     debugNumber("buffer = R[i]^m[i] mod n", public.vfySig.buffer);
     crypto_modmul(SIZE_N, public.vfySig.ZPrime, public.vfySig.buffer,
-      credential->issuerKey.n);
+      issuerKey.n);
     debugNumber("Z' = Z' * buffer mod n", public.vfySig.ZPrime);
   }
 
@@ -184,21 +446,31 @@ void verifySignature(void) {
     public.vfySig.buffer, public.vfySig.tmp);
   debugNumber("buffer = S^v mod n", public.vfySig.buffer);
   crypto_modmul(SIZE_N, public.vfySig.ZPrime, public.vfySig.buffer,
-    credential->issuerKey.n);
+    issuerKey.n);
   debugNumber("Z' = Z' * buffer mod n", public.vfySig.ZPrime);
-  crypto_modexp(SIZE_E, SIZE_N, credential->signature.e, credential->issuerKey.n,
+  crypto_modexp(SIZE_E, SIZE_N, credential->signature.e, issuerKey.n,
     credential->signature.A, public.vfySig.buffer);
   debugNumber("buffer = A^e mod n", public.vfySig.buffer);
   crypto_modmul(SIZE_N, public.vfySig.ZPrime, public.vfySig.buffer,
-    credential->issuerKey.n);
+    issuerKey.n);
   debugNumber("Z' = Z' * buffer mod n", public.vfySig.ZPrime);
 
   // - Verify Z =?= Z'
-  if (memcmp(credential->issuerKey.Z, public.vfySig.ZPrime, SIZE_N) != 0) {
-    // TODO: clear already stored things?
+  if (memcmp(issuerKey.Z, public.vfySig.ZPrime, SIZE_N) != 0) {
+    // Roll back the issuance of a credential committed in this session
+    if ((flags & FLAG_ISSUE_SIGNED) != 0) {
+      removeCredential();
+      flags &= ~FLAG_ISSUE_SIGNED;
+    }
     debugError("verifySignature(): verification of signature failed");
     ReturnSW(ISO7816_SW_CONDITIONS_NOT_SATISFIED);
   }
+
+  // Keep Q = A^e of a credential committed in this session for verifyProof()
+  if ((flags & FLAG_ISSUE_SIGNED) != 0) {
+    memcpy(session.vfyPrf.Q, public.vfySig.buffer, SIZE_N);
+    staged |= STAGED_SIGNATURE_Q;
+  }
 }
 
 /**
@@ -207,24 +479,27 @@ void verifySignature(void) {
  *   c =?= H(context, A^e, A, nonce, A^(c + s_e * e))
  *
  * @param signature (A, e) in credential->signature
- * @param issuerKey (n) in credential->issuerKey
+ * @param issuerKey (n) in issuerKeys
  * @param proof (nonce, context, challenge, response) in credential->proof
+ * @param Q = A^e in session.vfyPrf.Q, if kept by verifySignature()
  */
 void verifyProof(void) {
 
-  // Compute Q = A^e mod n
-  crypto_modexp(SIZE_E, SIZE_N, credential->signature.e,
-    credential->issuerKey.n, credential->signature.A, session.vfyPrf.Q);
+  // Compute Q = A^e mod n, unless it was kept by verifySignature()
+  if ((staged & STAGED_SIGNATURE_Q) == 0) {
+    crypto_modexp(SIZE_E, SIZE_N, credential->signature.e,
+      issuerKey.n, credential->signature.A, session.vfyPrf.Q);
+  }
   debugNumber("Q = A^e mod n", session.vfyPrf.Q);
 
   // Compute AHat = A^(c + s_e * e) = Q^s_e * A^c mod n
   crypto_modexp(SIZE_N, SIZE_N, credential->proof.response,
-    credential->issuerKey.n, session.vfyPrf.Q, public.vfyPrf.buffer);
-  debugNumber("buffer = Q^s_e mod n", public.vfyPrf.buffer);
+    issuerKey.n, session.vfyPrf.Q, public.vfyPrf.buffer.number);
+  debugNumber("buffer = Q^s_e mod n", public.vfyPrf.buffer.number);
   crypto_modexp(SIZE_H, SIZE_N, credential->proof.challenge,
-    credential->issuerKey.n, credential->signature.A, session.vfyPrf.AHat);
+    issuerKey.n, credential->signature.A, session.vfyPrf.AHat);
   debugNumber("AHat = A^c mod n", session.vfyPrf.AHat);
-  crypto_modmul(SIZE_N, session.vfyPrf.AHat, public.vfyPrf.buffer, credential->issuerKey.n);
+  crypto_modmul(SIZE_N, session.vfyPrf.AHat, public.vfyPrf.buffer.number, issuerKey.n);
   debugNumber("AHat = AHat * buffer", session.vfyPrf.AHat);
 
   // Compute challenge c' = H(context | Q | A | nonce | AHat)
@@ -239,12 +514,16 @@ void verifyProof(void) {
   session.vfyPrf.list[4].data = session.vfyPrf.AHat;
   session.vfyPrf.list[4].size = SIZE_N;
   crypto_compute_hash(session.vfyPrf.list, 5, session.vfyPrf.challenge,
-    public.vfyPrf.buffer, SIZE_BUFFER_C2);
+    public.vfyPrf.buffer.data, SIZE_BUFFER_C2);
   debugHash("c'", session.vfyPrf.challenge);
 
   // Verify c =?= c'
   if (memcmp(credential->proof.challenge, session.vfyPrf.challenge, SIZE_H) != 0) {
-    // TODO: clear already stored things?
+    // Roll back the issuance of a credential committed in this session
+    if ((flags & FLAG_ISSUE_SIGNED) != 0) {
+      removeCredential();
+      flags &= ~FLAG_ISSUE_SIGNED;
+    }
     debugError("verifyProof(): verification of P2 failed");
     ReturnSW(ISO7816_SW_CONDITIONS_NOT_SATISFIED);
   }
@@ -22,6 +22,7 @@
 #include <DES.h>
 #include <ISO7816.h>
 #include <multosarith.h>
+#include <multosccr.h> // for ZFlag()
 #include <multoscrypto.h>
 #include <string.h>
 
@@ -35,13 +36,142 @@
 /* Secure Messaging functions                                       */
 /********************************************************************/
 
+// Block size of the selected cipher
+#define SIZE_BLOCK (cipher == CIPHER_AES ? SIZE_AES_BLOCK : 8)
+
+/**
+ * Compute the AES initialisation vector IV = E(key_enc, 0 | SSC)
+ *
+ * @param block to store the initialisation vector
+ */
+void crypto_aes_iv(ByteArray block) {
+  memset(block, 0x00, SIZE_AES_BLOCK - SIZE_SSC);
+  memcpy(block + SIZE_AES_BLOCK - SIZE_SSC, ssc, SIZE_SSC);
+  crypto_aes_encipher(block, block, key_enc);
+}
+
+/**
+ * Encrypt data in place for secure messaging
+ *
+ * @param length of the (padded) data
+ * @param data to be encrypted
+ */
+void crypto_encipher(int length, ByteArray data) {
+  Byte chain[SIZE_AES_BLOCK];
+  int i, j;
+
+  if (cipher != CIPHER_AES) {
+    TripleDES2KeyCBCEncipherMessageNoPad(length, data, iv, key_enc, data);
+    return;
+  }
+
+  // CBC: C[i] = E(key_enc, P[i] ^ C[i - 1]) where C[-1] = IV
+  crypto_aes_iv(chain);
+  for (i = 0; i < length; i += SIZE_AES_BLOCK) {
+    for (j = 0; j < SIZE_AES_BLOCK; j++) {
+      data[i + j] ^= chain[j];
+    }
+    crypto_aes_encipher(data + i, data + i, key_enc);
+    memcpy(chain, data + i, SIZE_AES_BLOCK);
+  }
+}
+
+/**
+ * Decrypt data for secure messaging
+ *
+ * The data can be decrypted in place or moved to the front of the same
+ * buffer (out <= in), since each block is read before its plaintext is
+ * written and the plaintext never reaches the following blocks.
+ *
+ * @param length of the (padded) data
+ * @param in the encrypted data
+ * @param out the decrypted data
+ */
+void crypto_decipher(int length, ByteArray in, ByteArray out) {
+  Byte chain[SIZE_AES_BLOCK], block[SIZE_AES_BLOCK];
+  int i, j;
+
+  if (cipher != CIPHER_AES) {
+    TripleDES2KeyCBCDecipherMessageNoPad(length, in, iv, key_enc, out);
+    return;
+  }
+
+  // CBC: P[i] = D(key_enc, C[i]) ^ C[i - 1] where C[-1] = IV
+  crypto_aes_iv(chain);
+  for (i = 0; i < length; i += SIZE_AES_BLOCK) {
+    memcpy(block, in + i, SIZE_AES_BLOCK);
+    crypto_aes_decipher(block, out + i, key_enc);
+    for (j = 0; j < SIZE_AES_BLOCK; j++) {
+      out[i + j] ^= chain[j];
+    }
+    memcpy(chain, block, SIZE_AES_BLOCK);
+  }
+}
+
+/**
+ * Compute the MAC over data for secure messaging, possibly in parts
+ *
+ * For AES this is the CMAC truncated to SIZE_MAC bytes. Since the data
+ * is always padded, the last block is complete and only the subkey K1
+ * is needed.
+ *
+ * @param length of the (padded) part
+ * @param data of the part
+ * @param chain value of SIZE_AES_BLOCK bytes, zero before the first part,
+ *        of which the first SIZE_MAC bytes are the MAC after the last part
+ * @param last whether this is the last part
+ */
+void crypto_mac(int length, ByteArray data, ByteArray chain, Byte last) {
+  Byte subkey[SIZE_AES_BLOCK];
+  int i, j;
+
+  if (cipher != CIPHER_AES) {
+    // The CBC signature continues from the chain value as IV
+    memcpy(subkey, chain, SIZE_MAC);
+    GenerateTripleDESCBCSignature(length, subkey, key_mac, chain, data);
+    return;
+  }
+
+  // Derive the subkey K1 = L << 1 (^ 0x87 on carry) where L = E(key_mac, 0)
+  if (last) {
+    memset(subkey, 0x00, SIZE_AES_BLOCK);
+    crypto_aes_encipher(subkey, subkey, key_mac);
+    j = subkey[0] & 0x80;
+    for (i = 0; i < SIZE_AES_BLOCK - 1; i++) {
+      subkey[i] = (subkey[i] << 1) | (subkey[i + 1] >> 7);
+    }
+    subkey[SIZE_AES_BLOCK - 1] <<= 1;
+    if (j != 0) {
+      subkey[SIZE_AES_BLOCK - 1] ^= 0x87;
+    }
+  }
+
+  // CBC-MAC over the data, with K1 added to the last block
+  for (i = 0; i < length; i += SIZE_AES_BLOCK) {
+    for (j = 0; j < SIZE_AES_BLOCK; j++) {
+      chain[j] ^= data[i + j];
+      if (last && i + SIZE_AES_BLOCK == length) {
+        chain[j] ^= subkey[j];
+      }
+    }
+    crypto_aes_encipher(chain, chain, key_mac);
+  }
+
+  crypto_clear(SIZE_AES_BLOCK, subkey);
+}
+
 /**
  * Unwrap a command APDU from secure messaging
+ *
+ * The MAC is chained over the SSC and header block, the complete blocks
+ * of the cryptogram where they are and its padded last block, such that
+ * the cryptogram is never copied. The data is then decrypted once, from
+ * the do87 object to the front of the buffer.
  */
 #define buffer public.apdu.data
-#define tmp public.apdu.session
 void crypto_unwrap(void) {
-  Byte mac[SIZE_MAC];
+  Byte block[SIZE_AES_BLOCK];
+  Byte mac[SIZE_AES_BLOCK];
   int i;
   int offset = 0;
   int do87DataLen = 0;
@@ -81,57 +211,60 @@ void crypto_unwrap(void) {
   if (buffer[offset + 1] != 8) ExitSW(ISO7816_SW_DATA_INVALID);
 
   // verify mac
-  i = 0;
-
-  // SSC
-  COPYN(SIZE_SSC, tmp, ssc);
-  i += SIZE_SSC;
-
-  // Header
-  tmp[i++] = CLA;
-  tmp[i++] = INS;
-  tmp[i++] = P1;
-  tmp[i++] = P2;
-
-  // Padding
-  i = pad(tmp, i);
-
-  // Cryptogram (do87 and do97)
-  memcpy(tmp + i, buffer, offset);
-  do87Data_p += i;
-  i += offset;
-
-  // Padding
-  i = pad(tmp, i);
+  memset(mac, 0x00, SIZE_AES_BLOCK);
+
+  // SSC, header and padding
+  COPYN(SIZE_SSC, block, ssc);
+  i = SIZE_SSC;
+  block[i++] = CLA;
+  block[i++] = INS;
+  block[i++] = P1;
+  block[i++] = P2;
+  i = pad(block, i);
+  crypto_mac(i, block, mac, 0);
+
+  // Cryptogram (do87 and do97): complete blocks in place, then the
+  // remaining bytes with padding
+  i = offset - offset % SIZE_BLOCK;
+  if (i > 0) {
+    crypto_mac(i, buffer, mac, 0);
+  }
+  memcpy(block, buffer + i, offset - i);
+  i = pad(block, offset - i);
+  crypto_mac(i, block, mac, 1);
 
   // Verify the MAC
-  GenerateTripleDESCBCSignature(i, iv, key_mac, mac, tmp);
   if (memcmp(mac, buffer + offset + 2, SIZE_MAC) != 0) {
     ExitSW(ISO7816_SW_CONDITIONS_NOT_SATISFIED);
   }
 
   // Decrypt data if available
   if (do87DataLen != 0) {
-    TripleDES2KeyCBCDecipherMessageNoPad(do87DataLen, tmp + do87Data_p, iv, key_enc, buffer);
+    crypto_decipher(do87DataLen, buffer + do87Data_p, buffer);
     Lc = unpad(buffer, do87DataLen);
-    if (Lc > do87DataLen) {
+    if (Lc > (uint) do87DataLen) {
       ExitSW(ISO7816_SW_CONDITIONS_NOT_SATISFIED);
     }
   }
 }
 #undef buffer
-#undef tmp
 
 /**
  * Wrap a response APDU for secure messaging
+ *
+ * The response is wrapped in place, such that responses of any length
+ * that fits the public segment (including extended length) can be
+ * wrapped. The SSC is put in front of the cryptogram for the MAC
+ * computation and removed afterwards.
  */
 #define buffer public.apdu.data
-#define tmp public.apdu.session
 #define hasDo87 (La > 0)
 #define do87DataLenBytes (La > 0xff ? 2 : 1)
 #define do87DataLen (La + 1)
+#define do87HeaderLen (do87DataLen < 0x80 ? 3 : 3 + do87DataLenBytes)
 void crypto_wrap(void) {
-  int i, offset = 0;
+  Byte mac[SIZE_AES_BLOCK];
+  int i, offset = SIZE_SSC;
 
   INCN(SIZE_SSC, ssc);
 
@@ -139,60 +272,68 @@ void crypto_wrap(void) {
     // Padding
     La = pad(buffer, La);
 
+    // Make room for the SSC and the do87 header in front of the data
+    memmove(buffer + SIZE_SSC + do87HeaderLen, buffer, La);
+
     // Build do87 header
-    tmp[offset++] = 0x87;
+    buffer[offset++] = 0x87;
     if(do87DataLen < 0x80) {
-      tmp[offset++] = do87DataLen;
+      buffer[offset++] = do87DataLen;
     } else {
-      tmp[offset++] = 0x80 + do87DataLenBytes;
+      buffer[offset++] = 0x80 + do87DataLenBytes;
       for(i = do87DataLenBytes - 1; i >= 0; i--) {
-        tmp[offset++] = do87DataLen >> (i * 8);
+        buffer[offset++] = do87DataLen >> (i * 8);
       }
     }
-    tmp[offset++] = 0x01;
+    buffer[offset++] = 0x01;
 
-    // Build the do87 data
-    TripleDES2KeyCBCEncipherMessageNoPad(La, buffer, iv, key_enc, tmp + offset);
+    // Build the do87 data (encrypted in place)
+    crypto_encipher(La, buffer + offset);
     offset += La;
   }
 
   // build do99
-  tmp[offset++] = 0x99;
-  tmp[offset++] = 0x02;
-  tmp[offset++] = SW1;
-  tmp[offset++] = SW2;
+  buffer[offset++] = 0x99;
+  buffer[offset++] = 0x02;
+  buffer[offset++] = SW1;
+  buffer[offset++] = SW2;
 
   // padding
-  i = pad(tmp, offset);
+  i = pad(buffer, offset);
 
-  // calculate and write mac
-  COPYN(SIZE_SSC, tmp - SIZE_SSC, ssc);
-  GenerateTripleDESCBCSignature(i + SIZE_SSC, iv, key_mac, buffer + offset + 2, tmp - SIZE_SSC);
+  // calculate mac
+  COPYN(SIZE_SSC, buffer, ssc);
+  memset(mac, 0x00, SIZE_AES_BLOCK);
+  crypto_mac(i, buffer, mac, 1);
 
   // write do8e
-  tmp[offset++] = 0x8e;
-  tmp[offset++] = 0x08;
-  La = offset + 8; // for mac written earlier
-
-  // Put it all in the buffer (the mac is already there)
-  memcpy(buffer, tmp, offset);
+  buffer[offset++] = 0x8e;
+  buffer[offset++] = 0x08;
+  COPYN(SIZE_MAC, buffer + offset, mac);
+  offset += SIZE_MAC;
+
+  // Remove the SSC from the front of the response
+  La = offset - SIZE_SSC;
+  memmove(buffer, buffer + SIZE_SSC, La);
 }
 #undef buffer
-#undef tmp
-#undef hadDo87
+#undef hasDo87
 #undef do87DataLenBytes
 #undef do87DataLen
+#undef do87HeaderLen
 
 /**
  * Add padding to the input data according to ISO7816-4
  *
+ * The data is padded to the block size of the selected cipher.
+ *
  * @param data that needs to be padded
  * @param size of the data that needs to be padded
  * @return the new size of the data including padding
  */
 uint pad(ByteArray in, int length) {
   in[length++] = 0x80;
-  while (length % 8 != 0) {
+  while (length % SIZE_BLOCK != 0) {
     in[length++] = 0x00;
   }
   return length;
@@ -218,15 +359,22 @@ uint unpad(ByteArray in, int length) {
  * Derive session key from a given key seed and mode
  *
  * @param key to be stored
+ * @param size of the key seed
  * @param mode for which a key needs to be derived
+ * @param newCipher for which the key is derived
  */
 #define seed public.apdu.data
-void deriveSessionKey(ByteArray key, Byte mode) {
+void deriveSessionKey(ByteArray key, int size, Byte mode, Byte newCipher) {
   int i, j, bits;
 
   // Derive the session key for mode
-  seed[SIZE_KEY_SEED + 3] = mode;
-  SHA1(SIZE_KEY_SEED + 4, key, seed);
+  seed[size + 3] = mode;
+  SHA1(size + 4, key, seed);
+
+  // AES keys have no parity bits
+  if (newCipher == CIPHER_AES) {
+    return;
+  }
 
   // Compute the parity bits
   for (i = 0; i < SIZE_KEY; i++) {
@@ -242,26 +390,46 @@ void deriveSessionKey(ByteArray key, Byte mode) {
 
 /**
  * Derive session keys from a given key seed
+ *
+ * Also derives the ticket with which the next connection can resume
+ * secure messaging without card authentication.
+ *
+ * @param size of the key seed
+ * @param uses of the new ticket
+ * @param newCipher for which the keys are derived
  */
 #define seed public.apdu.data
-void crypto_derive_sessionkeys(void) {
+void crypto_derive_sessionkeys(int size, Byte uses, Byte newCipher) {
+  Ticket next;
+
   // Clear the seed suffix such that we can add a mode specific part
-  CLEARN(4, seed + SIZE_KEY_SEED);
+  CLEARN(4, seed + size);
 
   // Derive the session key for encryption
-  deriveSessionKey(seed + SIZE_KEY_SEED + 4, 0x01);
-  COPYN(SIZE_KEY, key_enc, seed + SIZE_KEY_SEED + 4);
-  COPYN(4, ssc, seed + SIZE_KEY_SEED + 4 + SIZE_KEY);
+  deriveSessionKey(seed + size + 4, size, 0x01, newCipher);
+  COPYN(SIZE_KEY, key_enc, seed + size + 4);
+  COPYN(4, ssc, seed + size + 4 + SIZE_KEY);
 
   // Derive the session key for authentication
-  deriveSessionKey(seed + SIZE_KEY_SEED + 4, 0x02);
-  COPYN(SIZE_KEY, key_mac, seed + SIZE_KEY_SEED + 4);
-  COPYN(4, ssc + 4, seed + SIZE_KEY_SEED + 4 + SIZE_KEY);
+  deriveSessionKey(seed + size + 4, size, 0x02, newCipher);
+  COPYN(SIZE_KEY, key_mac, seed + size + 4);
+  COPYN(4, ssc + 4, seed + size + 4 + SIZE_KEY);
+
+  // Derive the resumption ticket (key and identifier)
+  seed[size + 3] = 0x03;
+  SHA1(size + 4, seed + size + 4, seed);
+  COPYN(SIZE_KEY, next.key, seed + size + 4);
+  seed[size + 3] = 0x04;
+  SHA1(size + 4, seed + size + 4, seed);
+  COPYN(SIZE_TICKET_ID, next.id, seed + size + 4);
+  next.uses = uses;
+  memcpy(&ticket, &next, sizeof(Ticket));
+  crypto_clear(sizeof(Ticket), (ByteArray) &next);
 }
 #undef seed
 
 #define buffer public.apdu.data
-void crypto_authenticate_card(void) {
+void crypto_authenticate_card(Byte newCipher) {
   // Decrypt the session key seed input from the terminal
   crypto_modexp_secure(SIZE_RSA_EXPONENT, SIZE_RSA_MODULUS,
     rsaExponent, rsaModulus, buffer, buffer + SIZE_RSA_MODULUS);
@@ -270,9 +438,72 @@ void crypto_authenticate_card(void) {
   crypto_generate_random(buffer, LENGTH_KEY_SEED_CARD);
 
   // Derive the session keys
-  crypto_derive_sessionkeys();
+  crypto_derive_sessionkeys(SIZE_KEY_SEED, TICKET_USES, newCipher);
 
   // Clean up intermediate results
   CLEARN(SIZE_KEY_SEED_TERMINAL + 4 + SIZE_H, buffer + SIZE_KEY_SEED_CARD);
 }
 #undef buffer
+
+/**
+ * Perform card authentication and secure messaging setup using ECDH
+ *
+ *   seed = card nonce | x(eccKey * T)
+ *
+ * where T is the ephemeral point of the terminal. Only the card knows
+ * eccKey, which authenticates the card just like the RSA key transport.
+ */
+#define buffer public.apdu.data
+void crypto_authenticate_card_ecdh(Byte newCipher) {
+  // Verify that the point of the terminal is on the curve
+  crypto_ecc_verify(eccDomain, buffer);
+  ZFlag(&flag);
+  if (flag == 0) {
+    debugWarning("Invalid terminal point");
+    ExitSW(ISO7816_SW_WRONG_DATA);
+  }
+
+  // Compute the shared secret and put its x-coordinate after the nonce
+  crypto_ecc_multiply(eccDomain, buffer, eccKey, buffer + SIZE_ECC_POINT);
+  COPYN(SIZE_ECC, buffer + SIZE_ECDH_NONCE, buffer + SIZE_ECC_POINT + 1);
+
+  // Generate the session key seed input from the card
+  crypto_generate_random(buffer, LENGTH_ECDH_NONCE);
+
+  // Derive the session keys
+  crypto_derive_sessionkeys(SIZE_ECDH_SEED, TICKET_USES, newCipher);
+
+  // Clean up intermediate results
+  CLEARN(2*SIZE_ECC_POINT, buffer + SIZE_ECDH_NONCE);
+}
+#undef buffer
+
+/**
+ * Resume secure messaging with the ticket of a previous session
+ *
+ *   seed = card nonce | terminal nonce | ticket key
+ *
+ * Only a terminal which derived the ticket in a previous session can
+ * derive the new session keys. The ticket is replaced by a new one with
+ * one resumption less, so a full authentication is needed regularly.
+ */
+#define buffer public.apdu.data
+void crypto_resume_session(Byte newCipher) {
+  // Check the ticket identifier from the terminal
+  if (ticket.uses == 0 || memcmp(ticket.id, buffer, SIZE_TICKET_ID) != 0) {
+    debugWarning("Invalid resumption ticket");
+    ExitSW(ISO7816_SW_SECURITY_STATUS_NOT_SATISFIED);
+  }
+
+  // Construct the key seed from the nonces and the ticket key
+  memmove(buffer + SIZE_RESUME_NONCE, buffer + SIZE_TICKET_ID, SIZE_RESUME_NONCE);
+  crypto_generate_random(buffer, LENGTH_RESUME_NONCE);
+  COPYN(SIZE_KEY, buffer + 2*SIZE_RESUME_NONCE, ticket.key);
+
+  // Derive the session keys
+  crypto_derive_sessionkeys(SIZE_RESUME_SEED, ticket.uses - 1, newCipher);
+
+  // Clean up intermediate results
+  CLEARN(SIZE_RESUME_NONCE + SIZE_KEY + 4 + SIZE_H, buffer + SIZE_RESUME_NONCE);
+}
+#undef buffer
@@ -23,6 +23,7 @@
 #include <multosarith.h>
 #include <multosccr.h>
 #include <multoscrypto.h>
+#include <string.h>
 
 #include "defs_apdu.h"
 #include "defs_externals.h"
@@ -70,76 +71,234 @@ void selectAttributes(int selection) {
 }
 
 /**
- * Construct a proof.
+ * Derive eTilde and vTilde from the seed of the proof into eHat and vHat.
  */
-void constructProof(void) {
-  int i;
-
-#ifdef SIMULATOR
-  // Get context from session memory since the simulator clears public
-  COPYN(SIZE_H, public.prove.context, session.prove.context);
-#endif // SIMULATOR
-
-  // Generate random values for m~[i], e~, v~ and rA
-  for (i = 0; i <= credential->size; i++) {
-    if (disclosed(i) == 0) {
-      // IMPORTANT: Correction to the length of mTilde to prevent overflows
-      crypto_generate_random(session.prove.mHat[i], LENGTH_M_ - 1);
-    }
-  }
-  debugValues("mTilde", (ByteArray) session.prove.mHat, SIZE_M_, SIZE_L);
+void deriveProofRandomness(void) {
   // IMPORTANT: Correction to the length of eTilde to prevent overflows
-  crypto_generate_random(public.prove.eHat, LENGTH_E_ - 1);
+  crypto_derive_random(session.prove.seed, SEED_INDEX_E, public.prove.eHat, LENGTH_E_ - 1);
   debugValue("eTilde", public.prove.eHat, SIZE_E_);
   // IMPORTANT: Correction to the length of vTilde to prevent overflows
-  crypto_generate_random(public.prove.vHat, LENGTH_V_ - 1);
+  crypto_derive_random(session.prove.seed, SEED_INDEX_V, public.prove.vHat, LENGTH_V_ - 1);
   debugValue("vTilde", public.prove.vHat, SIZE_V_);
+}
+
+/**
+ * Derive r_A from the seed of the proof into vHat.
+ *
+ * Both A' = A * S^r_A and v' = v - e*r_A are computed before vTilde is
+ * derived into vHat, so r_A can borrow its space.
+ */
+void deriveProofRA(void) {
   // IMPORTANT: Correction to the length of rA to prevent negative values
-  crypto_generate_random(public.prove.rA + 1, LENGTH_R_A - 13);
-  public.prove.rA[0] = 0x00;
-  debugValue("rA", public.prove.rA, SIZE_R_A);
+  public.prove.vHat[0] = 0x00;
+  crypto_derive_random(session.prove.seed, SEED_INDEX_R_A, public.prove.vHat + 1,
+    LENGTH_R_A - 13);
+  debugValue("rA", public.prove.vHat, SIZE_R_A);
+}
+
+/**
+ * Precompute the nonce independent part of a proof.
+ *
+ *   A' = A * S^rA, ZTilde = A'^eTilde * S^vTilde * R[i]^mTilde[i]
+ *
+ * The rA, eTilde, vTilde and mTilde[i] are not stored, but derived from
+ * session.prove.seed whenever they are needed, such that no randomness
+ * is left in public memory in between commands.
+ */
+void precomputeProof(void) {
+  int i, k, n;
+  Byte first;
+
+  // Generate the seed for rA, e~, v~ and m~[i]
+  crypto_generate_random(session.prove.seed, 8*SIZE_SEED);
+  deriveProofRA();
 
   // Compute A' = A * S^r_A
   // IMPORTANT: Correction to the size of rA to skip initial zero bytes
-  crypto_modexp_special(SIZE_R_A - 1, public.prove.rA + 1, public.prove.APrime,
+  crypto_modexp_special(SIZE_R_A - 1, public.prove.vHat + 1, session.prove.APrime,
     public.prove.buffer.number[0]);
-  debugValue("A' = S^r_A mod n", public.prove.APrime, SIZE_N);
-  crypto_modmul(SIZE_N, public.prove.APrime, credential->signature.A, credential->issuerKey.n);
-  debugValue("A' = A' * A mod n", public.prove.APrime, SIZE_N);
+  debugValue("A' = S^r_A mod n", session.prove.APrime, SIZE_N);
+  crypto_modmul(SIZE_N, session.prove.APrime, credential->signature.A, issuerKey.n);
+  debugValue("A' = A' * A mod n", session.prove.APrime, SIZE_N);
+
+  // Replace rA by e~ and v~
+  deriveProofRandomness();
 
   // Compute ZTilde = A'^eTilde * S^vTilde * (R[i]^mTilde[i] foreach i not in D)
-  crypto_modexp_special(SIZE_V_, public.prove.vHat, public.prove.buffer.number[0],
-    public.prove.buffer.number[1]);
-  debugValue("ZTilde = S^vTilde", public.prove.buffer.number[0], SIZE_N);
-  crypto_modexp(SIZE_E_, SIZE_N, public.prove.eHat,
-    credential->issuerKey.n, public.prove.APrime, public.prove.buffer.number[1]);
-  debugValue("buffer = A'^eTilde", public.prove.buffer.number[1], SIZE_N);
-  crypto_modmul(SIZE_N, public.prove.buffer.number[0],
-    public.prove.buffer.number[1], credential->issuerKey.n);
-  debugValue("ZTilde = ZTilde * buffer", public.prove.buffer.number[0], SIZE_N);
+  // The mTilde[i] are derived SIZE_BATCH at a time, each batch in its own pass
+  public.prove.power[0].base = session.prove.APrime;
+  public.prove.power[0].exponent = public.prove.eHat;
+  public.prove.power[0].size = SIZE_E_;
+  // S^vTilde = S^(vTilde_bottom) * S_^(vTilde_top)
+  public.prove.power[1].base = issuerKey.S;
+  public.prove.power[1].exponent = public.prove.vHat + SIZE_V_ - SIZE_S_EXPONENT;
+  public.prove.power[1].size = SIZE_S_EXPONENT;
+  public.prove.power[2].base = issuerKey.S_;
+  public.prove.power[2].exponent = public.prove.vHat;
+  public.prove.power[2].size = SIZE_V_ - SIZE_S_EXPONENT;
+  n = 3;
+  first = 1;
+  k = 0;
   for (i = 0; i <= credential->size; i++) {
     if (disclosed(i) == 0) {
-      crypto_modexp(SIZE_M_, SIZE_N, session.prove.mHat[i], credential->issuerKey.n,
-        credential->issuerKey.R[i], public.prove.buffer.number[1]);
-      debugValue("R_i^m_i", public.prove.buffer.number[1], SIZE_N);
-      crypto_modmul(SIZE_N, public.prove.buffer.number[0],
-        public.prove.buffer.number[1], credential->issuerKey.n);
-      debugValue("ZTilde = ZTilde * buffer", public.prove.buffer.number[0], SIZE_N);
+      // IMPORTANT: Correction to the length of mTilde to prevent overflows
+      crypto_derive_random(session.prove.seed, i, session.prove.mTilde[k], LENGTH_M_ - 1);
+      public.prove.power[n].base = issuerKey.R[i];
+      public.prove.power[n].exponent = session.prove.mTilde[k];
+      public.prove.power[n].size = SIZE_M_;
+      n++;
+      k++;
+    }
+    if (n > 0 && (k == SIZE_BATCH || i == credential->size)) {
+      if (first) {
+        crypto_modexp_product(public.prove.power, n, issuerKey.n,
+          session.prove.ZTilde, public.prove.buffer.number[0]);
+        first = 0;
+      } else {
+        crypto_modexp_product(public.prove.power, n, issuerKey.n,
+          public.prove.buffer.number[1], public.prove.buffer.number[0]);
+        crypto_modmul(SIZE_N, session.prove.ZTilde, public.prove.buffer.number[1],
+          issuerKey.n);
+      }
+      n = 0;
+      k = 0;
     }
   }
+  crypto_clear(SIZE_BATCH*SIZE_M_, (ByteArray) session.prove.mTilde);
+  crypto_clear(SIZE_E_, public.prove.eHat);
+  crypto_clear(SIZE_V_, public.prove.vHat);
+  debugValue("ZTilde = A'^eTilde * S^vTilde * R[i]^mTilde[i]",
+    session.prove.ZTilde, SIZE_N);
+
+  flags |= FLAG_PROVE_PRECOMPUTED;
+}
+
+/**
+ * Store a precomputed proof commitment in the pool.
+ *
+ * The commitment is computed for the selected credential and disclosure
+ * selection, and it is only marked valid once it has been written
+ * completely.
+ */
+void pushProofCommitment(void) {
+  Byte k;
+
+  // Find a free slot in the pool
+  for (k = 0; k < SIZE_POOL && pool[k].valid != 0; k++);
+  if (k == SIZE_POOL) {
+    debugWarning("Proof commitment pool is full");
+    credential = NULL;
+    ReturnSW(ISO7816_SW_COMMAND_NOT_ALLOWED);
+  }
+
+  // Compute the commitment in the working memory
+  precomputeProof();
+  flags &= ~FLAG_PROVE_PRECOMPUTED;
+
+  // Store the commitment in the pool
+  memcpy(pool[k].APrime, session.prove.APrime, SIZE_N);
+  COPYN(SIZE_SEED, pool[k].seed, session.prove.seed);
+  memcpy(pool[k].ZTilde, session.prove.ZTilde, SIZE_N);
+  pool[k].selection = session.prove.disclose;
+  pool[k].id = credential->id;
+  pool[k].valid = 1;
+  debugInteger("Stored proof commitment", k);
+
+  // Erase the working copies, only the pool holds the randomness now
+  crypto_clear(SIZE_SEED, session.prove.seed);
+  crypto_clear(SIZE_N, session.prove.ZTilde);
+  crypto_clear(SIZE_E_, public.prove.eHat);
+  crypto_clear(SIZE_V_, public.prove.vHat);
+}
+
+/**
+ * Take a precomputed proof commitment from the pool.
+ *
+ * The commitment is invalidated before it is used and erased afterwards,
+ * such that it can never be used for a second proof.
+ *
+ * @return 1 if a commitment for the selected credential and disclosure
+ *         selection has been loaded, 0 otherwise.
+ */
+Byte popProofCommitment(void) {
+  Byte k;
+
+  for (k = 0; k < SIZE_POOL; k++) {
+    if (pool[k].valid != 0 && pool[k].id == credential->id &&
+        pool[k].selection == session.prove.disclose) {
+      pool[k].valid = 0;
+
+      // Load the commitment into the working memory
+      memcpy(session.prove.APrime, pool[k].APrime, SIZE_N);
+      COPYN(SIZE_SEED, session.prove.seed, pool[k].seed);
+      memcpy(session.prove.ZTilde, pool[k].ZTilde, SIZE_N);
+
+      // Erase the used randomness
+      crypto_clear(sizeof(ProofCommitment), (ByteArray) &pool[k]);
+      debugInteger("Loaded proof commitment", k);
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/**
+ * Remove all precomputed proof commitments for a credential from the pool.
+ *
+ * @param id of the credential.
+ */
+void dropProofCommitments(CredentialIdentifier id) {
+  Byte k;
+
+  for (k = 0; k < SIZE_POOL; k++) {
+    if (pool[k].id == id) {
+      pool[k].valid = 0;
+      crypto_clear(sizeof(ProofCommitment), (ByteArray) &pool[k]);
+    }
+  }
+}
+
+/**
+ * Construct a proof.
+ *
+ * Uses the precomputed A' and ZTilde if available, either from this
+ * session or from the pool, otherwise these are computed first.
+ */
+void constructProof(void) {
+
+  // Compute A' and ZTilde, unless this has already been done
+  if ((flags & FLAG_PROVE_PRECOMPUTED) == 0 && popProofCommitment() == 0) {
+    precomputeProof();
+  }
+
+  // The randomness for this proof must never be used again
+  flags &= ~FLAG_PROVE_PRECOMPUTED;
 
   // Compute challenge c = H(context | A' | ZTilde | nonce)
-  public.prove.list[0].data = public.prove.context;
-  public.prove.list[0].size = SIZE_H;
-  public.prove.list[1].data = public.prove.APrime;
-  public.prove.list[1].size = SIZE_N;
-  public.prove.list[2].data = public.prove.buffer.number[0];
-  public.prove.list[2].size = SIZE_N;
-  public.prove.list[3].data = public.prove.apdu.nonce;
-  public.prove.list[3].size = SIZE_STATZK;
-  crypto_compute_hash(public.prove.list, 4, public.prove.apdu.challenge,
-    public.prove.buffer.data, SIZE_BUFFER_C1);
+  // The encoding overlays the nonce, buffer and powers in public and may
+  // run into vHat, which is why e~ and v~ are only derived afterwards
+  session.prove.list[0].data = session.prove.context;
+  session.prove.list[0].size = SIZE_H;
+  session.prove.list[1].data = session.prove.APrime;
+  session.prove.list[1].size = SIZE_N;
+  session.prove.list[2].data = session.prove.ZTilde;
+  session.prove.list[2].size = SIZE_N;
+  session.prove.list[3].data = public.prove.apdu.nonce;
+  session.prove.list[3].size = SIZE_STATZK;
+  crypto_compute_hash(session.prove.list, 4, session.prove.challenge,
+    public.apdu.data, SIZE_BUFFER_C1);
+  COPYN(SIZE_H, public.prove.apdu.challenge, session.prove.challenge);
   debugValue("c", public.prove.apdu.challenge, SIZE_H);
+  flags |= FLAG_PROVE_CHALLENGED;
+
+  // Derive rA again, to compute v' in the buffer
+  deriveProofRA();
+  crypto_compute_vPrime(); // Compute v' = v - e r_A
+  debugValue("v' = v - e*r_A", public.prove.buffer.data, SIZE_V);
+
+  // Derive e~ and v~ again, the responses are computed in their place
+  deriveProofRandomness();
 
   crypto_compute_ePrime(); // Compute e' = e - 2^(l_e' - 1)
   debugValue("e' = e - 2^(l_e' - 1)",
@@ -148,25 +307,71 @@ void constructProof(void) {
   crypto_compute_eHat(); // Compute e^ = e~ + c e'
   debugValue("e^ = e~ + c*e'", public.prove.eHat, SIZE_E_);
 
-  crypto_compute_vPrime(); // Compute v' = v - e r_A
-  debugValue("v' = v - e*r_A", public.prove.buffer.data, SIZE_V);
-
   crypto_compute_vHat(); // Compute v^ = v~ + c v'
   debugValue("vHat", public.prove.vHat, SIZE_V_);
 
-  for (i = 0; i <= credential->size; i++) {
-    if (disclosed(i) == 0) {
-      crypto_compute_mHat(i); // Compute m_i^ = m_i~ + c m_i
-    }
-  }
-  debugValues("mHat", (ByteArray) session.prove.mHat, SIZE_M_, SIZE_L);
+  // The responses m_i^ are computed on demand, see constructResponseM()
 
 #ifdef SIMULATOR
   // Store responses in session memory since the simulator clears public
-  COPYN(SIZE_N, session.prove.APrime, public.prove.APrime);
   COPYN(SIZE_E_, session.prove.eHat, public.prove.eHat);
-  COPYN(SIZE_V_, session.prove.vHat, public.prove.vHat);
+  memcpy(session.prove.vHat, public.prove.vHat, SIZE_V_);
 #endif // SIMULATOR
 
   // return eHat, vHat, mHat[i], c, A'
 }
+
+/**
+ * Compute the response m_i^ = m_i~ + c*m_i for a hidden attribute.
+ *
+ * The randomness m_i~ is derived again from the seed of the proof.
+ *
+ * @param i index of the attribute.
+ * @param mHat buffer of SIZE_M_ bytes to store the response.
+ */
+void constructResponseM(Byte i, ByteArray mHat) {
+  // IMPORTANT: Correction to the length of mTilde to prevent overflows
+  crypto_derive_random(session.prove.seed, i, mHat, LENGTH_M_ - 1);
+  crypto_compute_mHat(i, mHat);
+  debugValue("m_i^ = m_i~ + c*m_i", mHat, SIZE_M_);
+}
+
+/**
+ * Collect all the values of a proof in a single response.
+ *
+ *   c | A' | e^ | v^ | (m_i if i in D, m_i^ otherwise) foreach i
+ *
+ * The values in public.prove are stored beyond the start of the part of
+ * the response they are moved to, so they are moved in this order.
+ * Afterwards e^ and v^ have been overwritten, so the proof can no longer
+ * be retrieved in parts.
+ *
+ * Only available if a complete proof (SIZE_PROOF) fits in public.
+ *
+ * @return the size of the response in public.apdu.data.
+ */
+Size constructProofResponse(void) {
+  Size offset = SIZE_H; // c is already in place
+  int i;
+
+  memcpy(public.apdu.data + offset, session.prove.APrime, SIZE_N);
+  offset += SIZE_N;
+  COPYN(SIZE_E_, public.apdu.data + offset, public.prove.eHat);
+  offset += SIZE_E_;
+  memmove(public.apdu.data + offset, public.prove.vHat, SIZE_V_);
+  offset += SIZE_V_;
+  for (i = 0; i <= credential->size; i++) {
+    if (disclosed(i)) {
+      COPYN(SIZE_M, public.apdu.data + offset, credential->attribute[i - 1]);
+      offset += SIZE_M;
+    } else {
+      constructResponseM(i, public.apdu.data + offset);
+      offset += SIZE_M_;
+    }
+  }
+
+  // Refuse any later request for e^ or v^
+  flags &= ~FLAG_PROVE_CHALLENGED;
+
+  return offset;
+}
@@ -21,6 +21,7 @@
 
 #include <string.h> // for memcpy()
 
+#include "defs_externals.h"
 #include "funcs_debug.h"
 
 /********************************************************************/
@@ -125,3 +126,95 @@ int asn1_encode_seq(int length, int size, ByteArray buffer, int offset) {
 
   return offset;
 }
+
+/**
+ * Encode a log entry compactly, leaving out the unused details
+ *
+ *   timestamp | terminal | action | credential [| selection]
+ *
+ * Only proving records details (the disclosed attributes).
+ *
+ * @param entry to be encoded
+ * @param buffer to store the encoding
+ * @return the length of the encoding
+ */
+int log_encode_entry(LogEntry *entry, ByteArray buffer) {
+  int length = SIZE_TIMESTAMP + SIZE_TERMINAL_ID + 1;
+
+  memcpy(buffer, entry, length);
+  buffer[length++] = entry->credential >> 8;
+  buffer[length++] = entry->credential & 0xFF;
+  if (entry->action == ACTION_PROVE) {
+    buffer[length++] = entry->details.prove.selection >> 8;
+    buffer[length++] = entry->details.prove.selection & 0xFF;
+  }
+
+  return length;
+}
+
+/**
+ * Lookup the slot of the credential with the given identifier
+ *
+ * Only the index is scanned, which is a single contiguous block instead
+ * of the identifiers scattered over the (large) credential slots. An
+ * identifier is only trusted if the bitmap marks its slot as occupied.
+ *
+ * @param id of the credential
+ * @return the slot of the credential, or MAX_CRED if it does not exist
+ */
+Byte credential_lookup(CredentialIdentifier id) {
+  Byte i;
+
+  if (id == 0) {
+    return MAX_CRED;
+  }
+  for (i = 0; i < MAX_CRED; i++) {
+    if ((credentialIndex.used[i / 8] & (1 << (i % 8))) != 0 &&
+        credentialIndex.id[i] == id) {
+      return i;
+    }
+  }
+  return MAX_CRED;
+}
+
+/**
+ * Find a free credential slot using the bitmap of occupied slots
+ *
+ * Fully occupied groups of eight slots are skipped at once.
+ *
+ * @return a free slot, or MAX_CRED if all slots are occupied
+ */
+Byte credential_allocate(void) {
+  Byte i, j;
+
+  for (i = 0; i < sizeof(credentialIndex.used); i++) {
+    if (credentialIndex.used[i] != 0xFF) {
+      for (j = 0; (credentialIndex.used[i] & (1 << j)) != 0; j++);
+      return 8*i + j < MAX_CRED ? 8*i + j : MAX_CRED;
+    }
+  }
+  return MAX_CRED;
+}
+
+/**
+ * Enter the current credential into the index, occupying its slot
+ */
+void credential_index(void) {
+  Byte slot = credential - credentials;
+
+  credentialIndex.id[slot] = credential->id;
+  credentialIndex.used[slot / 8] |= 1 << (slot % 8);
+}
+
+/**
+ * Remove the current credential from the index, freeing its slot
+ *
+ * Clearing the bitmap bit is the single commit point, the identifier is
+ * only erased afterwards.
+ */
+void credential_unindex(void) {
+  Byte slot = credential - credentials;
+
+  credentialIndex.used[slot / 8] &= ~(1 << (slot % 8));
+  credentialIndex.id[slot] = 0;
+}
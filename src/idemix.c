@@ -58,10 +58,20 @@ Credential *credential; // + 2 = 669
 Byte flags; // + 1 = 670
 Byte flag;
 
+// Issuance: offset in a (chained) bulk upload
+int bulk;
+
+// Issuance: parts of the signature staged in this session
+Byte staged;
+
+// Proving: number of proof commitments stored in this session
+Byte refills;
+
 // Secure messaging: send sequence counter and session keys
 Counter ssc; // 8
 Byte key_enc[SIZE_KEY];
 Byte key_mac[SIZE_KEY];
+Byte cipher;
 Byte terminal[SIZE_TERMINAL_ID];
 
 /********************************************************************/
@@ -69,10 +79,16 @@ Byte terminal[SIZE_TERMINAL_ID];
 /********************************************************************/
 #pragma melstatic
 
-// Idemix: credentials and master secret
+// Idemix: credentials, issuer keys and master secret
 Credential credentials[MAX_CRED];
+CredentialIndex credentialIndex; // id-to-slot index and free-slot bitmap
+IssuerKey issuerKeys[MAX_KEY];
 CLMessage masterSecret;
 
+// Issuance: credential which is not yet committed, rolled back unless
+// its issuance is completed
+Credential *pending;
+
 // Card holder verification: PIN
 PIN cardPIN = {
   { 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x00, 0x00 },
@@ -91,13 +107,23 @@ PIN credPIN = {
 Byte rsaExponent[SIZE_RSA_EXPONENT];
 Byte rsaModulus[SIZE_RSA_MODULUS];
 
+// Card authentication: ECC private key (P-256)
+Byte eccKey[SIZE_ECC];
+
 // Secure messaging: initialisation vector
 Byte iv[SIZE_IV];
 
+// Secure messaging: resumption ticket
+Ticket ticket;
+
+// Proving: pool of precomputed proof commitments
+ProofCommitment pool[SIZE_POOL];
+
 // Logging
 LogEntry *log;
 LogEntry logList[SIZE_LOG];
 Byte logHead = 0;
+uint logSequence = 0; // number of entries ever logged (modulo 2^16)
 
 
 /********************************************************************/
@@ -105,7 +131,8 @@ Byte logHead = 0;
 /********************************************************************/
 
 void main(void) {
-  int i;
+  int i, length;
+  Byte k;
 
   // Check whether the APDU has been wrapped for secure messaging
   if (wrapped) {
@@ -116,7 +143,22 @@ void main(void) {
     debugValue("Unwrapped APDU", public.apdu.data, Lc);
   }
 
-  switch (CLA & 0xF3) {
+  // Command chaining is only supported for a bulk upload, of which the
+  // chain is broken off by any other command
+  if (!bulkUpload) {
+    if (chained) {
+      ReturnSW(ISO7816_SW_CLA_NOT_SUPPORTED);
+    }
+    flags &= ~FLAG_ISSUE_BULK;
+  }
+
+  // Roll back an issuance which has been interrupted or abandoned
+  if (pending != NULL && (credential != pending ||
+      ((CLA & 0xE3) == CLA_IRMACARD && (INS & 0xF0) != INS_ISSUE_CREDENTIAL))) {
+    abortIssuance();
+  }
+
+  switch (CLA & 0xE3) {
 
     //////////////////////////////////////////////////////////////////
     // Generic functionality                                        //
@@ -135,9 +177,39 @@ void main(void) {
           break;
 
         case ISO7816_INS_INTERNAL_AUTHENTICATE:
-          // Perform card authentication & secure messaging setup
-          crypto_authenticate_card();
-          ReturnLa(ISO7816_SW_NO_ERROR, SIZE_KEY_SEED_CARD);
+          // Perform card authentication & secure messaging setup, where
+          // P1 selects the cipher for secure messaging once the session
+          // keys have been derived
+          if (P1 != CIPHER_3DES && P1 != CIPHER_AES) {
+            ReturnSW(ISO7816_SW_WRONG_P1P2);
+          }
+
+          // P2 selects whether a previous session is resumed
+          switch (P2) {
+            case P2_AUTHENTICATE_FULL:
+              crypto_authenticate_card(P1);
+              cipher = P1;
+              ReturnLa(ISO7816_SW_NO_ERROR, SIZE_KEY_SEED_CARD);
+
+            case P2_AUTHENTICATE_RESUME:
+              if (Lc != SIZE_TICKET_ID + SIZE_RESUME_NONCE) {
+                ReturnSW(ISO7816_SW_WRONG_LENGTH);
+              }
+              crypto_resume_session(P1);
+              cipher = P1;
+              ReturnLa(ISO7816_SW_NO_ERROR, SIZE_RESUME_NONCE);
+
+            case P2_AUTHENTICATE_ECDH:
+              if (Lc != SIZE_ECC_POINT) {
+                ReturnSW(ISO7816_SW_WRONG_LENGTH);
+              }
+              crypto_authenticate_card_ecdh(P1);
+              cipher = P1;
+              ReturnLa(ISO7816_SW_NO_ERROR, SIZE_ECDH_NONCE);
+
+            default:
+              ReturnSW(ISO7816_SW_WRONG_P1P2);
+          }
           break;
 
         //////////////////////////////////////////////////////////////
@@ -236,6 +308,11 @@ void main(void) {
           // Use the test value for the master secret
           COPYN(SIZE_M, masterSecret, public.apdu.data);
 #endif // TEST
+          // Drop the values derived from an earlier master secret
+          for (k = 0; k < MAX_KEY; k++) {
+            crypto_clear(SIZE_N, issuerKeys[k].secret);
+            issuerKeys[k].cached = 0;
+          }
           debugValue("Initialised master secret", masterSecret, SIZE_M);
           ReturnSW(ISO7816_SW_NO_ERROR);
 
@@ -265,6 +342,16 @@ void main(void) {
               debugValue("Initialised rsaModulus", rsaModulus, SIZE_RSA_MODULUS);
               break;
 
+            case P1_AUTHENTICATION_ECC:
+              debugMessage("P1_AUTHENTICATION_ECC");
+              if (!((wrapped || CheckCase(3)) && Lc == SIZE_ECC)) {
+                ReturnSW(ISO7816_SW_WRONG_LENGTH);
+              }
+
+              COPYN(SIZE_ECC, eccKey, public.apdu.data);
+              debugValue("Initialised eccKey", eccKey, SIZE_ECC);
+              break;
+
             default:
               debugWarning("Unknown parameter");
               ReturnSW(ISO7816_SW_WRONG_P1P2);
@@ -280,47 +367,84 @@ void main(void) {
           if (!pin_verified(credPIN)) {
             ReturnSW(ISO7816_SW_SECURITY_STATUS_NOT_SATISFIED);
           }
-          if (!((wrapped || CheckCase(3)) &&
+          if (!(((wrapped || CheckCase(3)) &&
               (Lc == sizeof(CredentialIdentifier) + sizeof(Hash) + sizeof(Size) + sizeof(CredentialFlags)
-              || Lc == sizeof(CredentialIdentifier) + sizeof(Hash) + sizeof(Size) + sizeof(CredentialFlags) + SIZE_TIMESTAMP))) {
+              || Lc == sizeof(CredentialIdentifier) + sizeof(Hash) + sizeof(Size) + sizeof(CredentialFlags) + SIZE_TIMESTAMP)) ||
+              ((wrapped || CheckCase(4)) &&
+              Lc == sizeof(CredentialIdentifier) + sizeof(Hash) + sizeof(Size) + sizeof(CredentialFlags) + SIZE_TIMESTAMP + sizeof(Hash)))) {
             ReturnSW(ISO7816_SW_WRONG_LENGTH);
           }
           if (P1P2 != 0) {
             ReturnSW(ISO7816_SW_WRONG_P1P2);
           }
 
-          // Prevent reissuance of a credential
-          for (i = 0; i < MAX_CRED; i++) {
-            if (credentials[i].id == public.issuanceSetup.id) {
-              debugWarning("Credential already exists");
-              ReturnSW(ISO7816_SW_COMMAND_NOT_ALLOWED_AGAIN);
-            }
+          // Roll back a previous issuance which has not been completed
+          if (pending != NULL) {
+            abortIssuance();
           }
 
-          // Create a new credential
-          for (i = 0; i < MAX_CRED; i++) {
-            if (credentials[i].id == 0) {
-              credential = &credentials[i];
-              credential->id = public.issuanceSetup.id;
-              credential->size = public.issuanceSetup.size;
-              credential->issuerFlags = public.issuanceSetup.flags;
-              COPYN(SIZE_H, credential->proof.context, public.issuanceSetup.context);
-              debugHash("Initialised context", credential->proof.context);
+          // Prevent reissuance of a credential
+          if (credential_lookup(public.issuanceSetup.id) != MAX_CRED) {
+            debugWarning("Credential already exists");
+            ReturnSW(ISO7816_SW_COMMAND_NOT_ALLOWED_AGAIN);
+          }
 
-              // Create new log entry
-              log_new_entry();
-              COPYN(SIZE_TIMESTAMP, log->timestamp, public.issuanceSetup.timestamp);
-              COPYN(SIZE_TERMINAL_ID, log->terminal, terminal);
-              log->action = ACTION_ISSUE;
-              log->credential = credential->id;
+          // Find a free credential slot
+          i = credential_allocate();
+          if (i == MAX_CRED) {
+            // Out of space (all credential slots are occupied)
+            debugWarning("Cannot issue another credential");
+            ReturnSW(ISO7816_SW_COMMAND_NOT_ALLOWED);
+          }
+
+          // Find the issuer key, which is shared if its fingerprint is given
+          k = findIssuerKey(Lc > sizeof(CredentialIdentifier) + sizeof(Hash) + sizeof(Size) +
+            sizeof(CredentialFlags) + SIZE_TIMESTAMP ? public.issuanceSetup.fingerprint : NULL);
+          if (k == MAX_KEY) {
+            // Out of space (all issuer key entries are occupied)
+            debugWarning("Cannot store another issuer key");
+            ReturnSW(ISO7816_SW_COMMAND_NOT_ALLOWED);
+          }
+
+          // Erase what is left of a key of which the release was interrupted
+          if (countIssuerKeyUsers(k) == 0 && issuerKeys[k].loaded != 0) {
+            crypto_clear(sizeof(IssuerKey), (ByteArray) &issuerKeys[k]);
+          }
+
+          // Create a new credential, journaled until its issuance is completed
+          flags &= ~(FLAG_ISSUE_PRECOMPUTED | FLAG_ISSUE_COMMITTED | FLAG_ISSUE_SIGNED | FLAG_ISSUE_BULK | FLAG_PROVE_PRECOMPUTED | FLAG_PROVE_CHALLENGED);
+          staged = 0;
+          credential = &credentials[i];
+          pending = credential;
+          credential->id = public.issuanceSetup.id;
+          credential->issuer = k;
+          credential_index();
+          credential->size = public.issuanceSetup.size;
+          credential->issuerFlags = public.issuanceSetup.flags;
+          COPYN(SIZE_H, credential->proof.context, public.issuanceSetup.context);
+          debugHash("Initialised context", credential->proof.context);
+
+          // Create new log entry
+          log_new_entry();
+          COPYN(SIZE_TIMESTAMP, log->timestamp, public.issuanceSetup.timestamp);
+          COPYN(SIZE_TERMINAL_ID, log->terminal, terminal);
+          log->action = ACTION_ISSUE;
+          log->credential = credential->id;
+
+          if (Lc <= sizeof(CredentialIdentifier) + sizeof(Hash) + sizeof(Size) +
+              sizeof(CredentialFlags) + SIZE_TIMESTAMP) {
+            ReturnSW(ISO7816_SW_NO_ERROR);
+          }
 
-              ReturnSW(ISO7816_SW_NO_ERROR);
-            }
+          // Precompute U and UTilde if the issuer key is already complete
+          if (issuerKeys[credential->issuer].loaded > KEY_R + credential->size) {
+            precomputeCommitment();
           }
 
-          // Out of space (all credential slots are occupied)
-          debugWarning("Cannot issue another credential");
-          ReturnSW(ISO7816_SW_COMMAND_NOT_ALLOWED);
+          // Return the number of issuer key components which are present
+          public.apdu.data[0] = issuerKeys[credential->issuer].loaded;
+          debugInteger("Issuer key components present", public.apdu.data[0]);
+          ReturnLa(ISO7816_SW_NO_ERROR, 1);
 
         case INS_ISSUE_PUBLIC_KEY:
           debugMessage("INS_ISSUE_PUBLIC_KEY");
@@ -330,43 +454,107 @@ void main(void) {
           if (credential == NULL) {
             ReturnSW(ISO7816_SW_CONDITIONS_NOT_SATISFIED);
           }
-          if (!((wrapped || CheckCase(3)) && Lc == SIZE_N)) {
-            ReturnSW(ISO7816_SW_WRONG_LENGTH);
-          }
 
-          switch (P1) {
-            case P1_PUBLIC_KEY_N:
-              debugMessage("P1_PUBLIC_KEY_N");
-              COPYN(SIZE_N, credential->issuerKey.n, public.apdu.data);
-              debugNumber("Initialised isserKey.n", credential->issuerKey.n);
-              break;
+          if (P1 == P1_PUBLIC_KEY_BULK) {
+            debugMessage("P1_PUBLIC_KEY_BULK");
+            if (!(wrapped || CheckCase(3))) {
+              ReturnSW(ISO7816_SW_WRONG_LENGTH);
+            }
 
-            case P1_PUBLIC_KEY_Z:
-              debugMessage("P1_PUBLIC_KEY_Z");
-              COPYN(SIZE_N, credential->issuerKey.Z, public.apdu.data);
-              debugNumber("Initialised isserKey.Z", credential->issuerKey.Z);
-              break;
+            // The first segment starts at key component P2, such that the
+            // components which are already present can be skipped
+            if ((flags & FLAG_ISSUE_BULK) == 0) {
+              if (P2 > issuerKeys[credential->issuer].loaded) {
+                ReturnSW(ISO7816_SW_WRONG_P1P2);
+              }
+              bulk = P2*SIZE_N;
+              flags |= FLAG_ISSUE_BULK;
+            }
+            if (bulk + (int) Lc > SIZE_BULK(credential->size)) {
+              flags &= ~FLAG_ISSUE_BULK;
+              ReturnSW(ISO7816_SW_WRONG_LENGTH);
+            }
+            bulk = storeBulk(bulk, public.apdu.data, Lc);
 
-            case P1_PUBLIC_KEY_S:
-              debugMessage("P1_PUBLIC_KEY_S");
-              COPYN(SIZE_N, credential->issuerKey.S, public.apdu.data);
-              debugNumber("Initialised isserKey.S", credential->issuerKey.S);
-              crypto_compute_S_();
-              debugNumber("Initialised isserKey.S_", credential->issuerKey.S_);
-              break;
+            // Complete the key components which have been received in full
+            while (issuerKeys[credential->issuer].loaded < KEY_R + 1 + credential->size &&
+                (issuerKeys[credential->issuer].loaded + 1)*SIZE_N <= bulk) {
+              completeIssuerKey(issuerKeys[credential->issuer].loaded);
+            }
 
-            case P1_PUBLIC_KEY_R:
-              debugMessage("P1_PUBLIC_KEY_R");
-              if (P2 > MAX_ATTR) {
+            // Wait for the next segment of a chained command
+            if (chained) {
+              ReturnSW(ISO7816_SW_NO_ERROR);
+            }
+            flags &= ~FLAG_ISSUE_BULK;
+            if (bulk != SIZE_BULK(credential->size)) {
+              debugWarning("Incomplete bulk upload");
+              ReturnSW(ISO7816_SW_WRONG_LENGTH);
+            }
+            for (i = 0; i < credential->size; i++) {
+              TESTN(SIZE_M, credential->attribute[i]);
+              ZFlag(&flag);
+              if (flag != 0) {
+                debugWarning("Attribute cannot be empty");
+                ReturnSW(ISO7816_SW_WRONG_DATA);
+              }
+            }
+            i = KEY_R + credential->size;
+          } else {
+            if (!((wrapped || CheckCase(3)) && Lc == SIZE_N)) {
+              ReturnSW(ISO7816_SW_WRONG_LENGTH);
+            }
+
+            switch (P1) {
+              case P1_PUBLIC_KEY_N:
+                debugMessage("P1_PUBLIC_KEY_N");
+                i = KEY_N;
+                break;
+
+              case P1_PUBLIC_KEY_Z:
+                debugMessage("P1_PUBLIC_KEY_Z");
+                i = KEY_Z;
+                break;
+
+              case P1_PUBLIC_KEY_S:
+                debugMessage("P1_PUBLIC_KEY_S");
+                i = KEY_S;
+                break;
+
+              case P1_PUBLIC_KEY_R:
+                debugMessage("P1_PUBLIC_KEY_R");
+                if (P2 > MAX_ATTR) {
+                  ReturnSW(ISO7816_SW_WRONG_P1P2);
+                }
+                i = KEY_R + P2;
+                break;
+
+              default:
+                debugWarning("Unknown parameter");
                 ReturnSW(ISO7816_SW_WRONG_P1P2);
+            }
+
+            // Components are stored in order, and a stored (possibly shared)
+            // component is only accepted again if it is unchanged
+            if (i > issuerKeys[credential->issuer].loaded) {
+              debugWarning("Issuer key component out of order");
+              ReturnSW(ISO7816_SW_CONDITIONS_NOT_SATISFIED);
+            }
+            if (i < issuerKeys[credential->issuer].loaded) {
+              if (memcmp(issuerKey.n + i*SIZE_N, public.apdu.data, SIZE_N) != 0) {
+                debugWarning("Issuer key component differs from the stored one");
+                ReturnSW(ISO7816_SW_COMMAND_NOT_ALLOWED);
               }
-              COPYN(SIZE_N, credential->issuerKey.R[P2], public.apdu.data);
-              debugNumberI("Initialised isserKey.R", credential->issuerKey.R, P2);
-              break;
+              debugMessage("Issuer key component already present");
+            } else {
+              memcpy(issuerKey.n + i*SIZE_N, public.apdu.data, SIZE_N);
+              completeIssuerKey(i);
+            }
+          }
 
-            default:
-              debugWarning("Unknown parameter");
-              ReturnSW(ISO7816_SW_WRONG_P1P2);
+          // Precompute U and UTilde once the last required R[i] is loaded
+          if (i == KEY_R + credential->size && (flags & FLAG_ISSUE_PRECOMPUTED) == 0) {
+            precomputeCommitment();
           }
           ReturnSW(ISO7816_SW_NO_ERROR);
 
@@ -403,6 +591,10 @@ void main(void) {
           if (credential == NULL) {
             ReturnSW(ISO7816_SW_CONDITIONS_NOT_SATISFIED);
           }
+          if (issuerKeys[credential->issuer].loaded <= KEY_R + credential->size) {
+            debugWarning("Issuer key is incomplete");
+            ReturnSW(ISO7816_SW_CONDITIONS_NOT_SATISFIED);
+          }
           if (!((wrapped || CheckCase(3)) && Lc == SIZE_STATZK)) {
             ReturnSW(ISO7816_SW_WRONG_LENGTH);
           }
@@ -421,6 +613,9 @@ void main(void) {
           if (credential == NULL) {
             ReturnSW(ISO7816_SW_CONDITIONS_NOT_SATISFIED);
           }
+          if ((flags & FLAG_ISSUE_COMMITTED) == 0) {
+            ReturnSW(ISO7816_SW_CONDITIONS_NOT_SATISFIED);
+          }
           if (!(wrapped || CheckCase(1))) {
             ReturnSW(ISO7816_SW_WRONG_LENGTH);
           }
@@ -434,13 +629,13 @@ void main(void) {
 
             case P1_PROOF_VPRIMEHAT:
               debugMessage("P1_COMMITMENT_PROOF_VPRIMEHAT");
-              COPYN(SIZE_VPRIME_, public.apdu.data, session.issue.vPrimeHat);
+              memcpy(public.apdu.data, session.issue.proof.response.vPrimeHat, SIZE_VPRIME_);
               debugValue("Returned vPrimeHat", public.apdu.data, SIZE_VPRIME_);
               ReturnLa(ISO7816_SW_NO_ERROR, SIZE_VPRIME_);
 
             case P1_PROOF_SHAT:
               debugMessage("P1_COMMITMENT_PROOF_SHAT");
-              COPYN(SIZE_S_, public.apdu.data, session.issue.sHat);
+              COPYN(SIZE_S_, public.apdu.data, session.issue.proof.response.sHat);
               debugValue("Returned s_A", public.apdu.data, SIZE_S_);
               ReturnLa(ISO7816_SW_NO_ERROR, SIZE_S_);
 
@@ -457,6 +652,9 @@ void main(void) {
           if (credential == NULL) {
             ReturnSW(ISO7816_SW_CONDITIONS_NOT_SATISFIED);
           }
+          if ((flags & FLAG_ISSUE_COMMITTED) == 0) {
+            ReturnSW(ISO7816_SW_CONDITIONS_NOT_SATISFIED);
+          }
           if (!(wrapped || CheckCase(1))) {
             ReturnSW(ISO7816_SW_WRONG_LENGTH);
           }
@@ -481,8 +679,11 @@ void main(void) {
                 ReturnSW(ISO7816_SW_WRONG_LENGTH);
               }
 
-              COPYN(SIZE_N, credential->signature.A, public.apdu.data);
-              debugNumber("Initialised signature.A", credential->signature.A);
+              // Stage A, the signature is stored once it is complete
+              flags &= ~(FLAG_ISSUE_PRECOMPUTED | FLAG_ISSUE_COMMITTED);
+              memcpy(session.sign.signature.A, public.apdu.data, SIZE_N);
+              staged = (staged & ~STAGED_SIGNATURE_Q) | STAGED_SIGNATURE_A;
+              debugNumber("Initialised signature.A", session.sign.signature.A);
               break;
 
             case P1_SIGNATURE_E:
@@ -491,8 +692,11 @@ void main(void) {
                 ReturnSW(ISO7816_SW_WRONG_LENGTH);
               }
 
-              COPYN(SIZE_E, credential->signature.e, public.apdu.data);
-              debugValue("Initialised signature.e", credential->signature.e, SIZE_E);
+              // Stage e, the signature is stored once it is complete
+              flags &= ~(FLAG_ISSUE_PRECOMPUTED | FLAG_ISSUE_COMMITTED);
+              COPYN(SIZE_E, session.sign.signature.e, public.apdu.data);
+              staged = (staged & ~STAGED_SIGNATURE_Q) | STAGED_SIGNATURE_E;
+              debugValue("Initialised signature.e", session.sign.signature.e, SIZE_E);
               break;
 
             case P1_SIGNATURE_V:
@@ -500,6 +704,14 @@ void main(void) {
               if (!((wrapped || CheckCase(3)) && Lc == SIZE_V)) {
                 ReturnSW(ISO7816_SW_WRONG_LENGTH);
               }
+              if (pending != credential) {
+                debugWarning("Credential is not being issued");
+                ReturnSW(ISO7816_SW_CONDITIONS_NOT_SATISFIED);
+              }
+              if (staged != (STAGED_COMMITMENT | STAGED_SIGNATURE_A | STAGED_SIGNATURE_E)) {
+                debugWarning("Signature is incomplete or has no commitment");
+                ReturnSW(ISO7816_SW_CONDITIONS_NOT_SATISFIED);
+              }
 
               constructSignature();
               debugValue("Initialised signature.v", credential->signature.v, SIZE_V);
@@ -547,7 +759,7 @@ void main(void) {
                 ReturnSW(ISO7816_SW_WRONG_LENGTH);
               }
 
-              COPYN(SIZE_N, credential->proof.response, public.apdu.data);
+              memcpy(credential->proof.response, public.apdu.data, SIZE_N);
               debugNumber("Initialised s_e", credential->proof.response);
               break;
 
@@ -577,43 +789,81 @@ void main(void) {
               (Lc == 2 + SIZE_H + 2 || Lc == 2 + SIZE_H + 2 + SIZE_TIMESTAMP || Lc == 2 + SIZE_H + 2 + SIZE_TIMESTAMP + SIZE_TERMINAL_ID))) {
             ReturnSW(ISO7816_SW_WRONG_LENGTH);
           }
-          if (P1P2 != 0) {
+          if ((P1 != P1_PROVE_DEFAULT && P1 != P1_PROVE_PRECOMPUTE) || P2 != 0) {
             ReturnSW(ISO7816_SW_WRONG_P1P2);
           }
 
           // FIXME: should be done during auth.
           COPYN(SIZE_TERMINAL_ID, terminal, public.verificationSetup.terminal);
 
+          // Proving reuses the session memory of a pending issuance
+          flags &= ~(FLAG_ISSUE_PRECOMPUTED | FLAG_ISSUE_COMMITTED | FLAG_ISSUE_SIGNED | FLAG_ISSUE_BULK | FLAG_PROVE_PRECOMPUTED | FLAG_PROVE_CHALLENGED);
+          staged = 0;
+
           // Lookup the given credential ID and select it if it exists
-          for (i = 0; i < MAX_CRED; i++) {
-            if (credentials[i].id == public.verificationSetup.id) {
-              credential = &credentials[i];
+          i = credential_lookup(public.verificationSetup.id);
+          if (i == MAX_CRED) {
+            ReturnSW(ISO7816_SW_REFERENCED_DATA_NOT_FOUND);
+          }
 
-              selectAttributes(public.verificationSetup.selection);
+          credential = &credentials[i];
 
-              if (pin_required && !pin_verified(credPIN)) {
-                credential = NULL;
-                ReturnSW(ISO7816_SW_SECURITY_STATUS_NOT_SATISFIED);
-              }
+          selectAttributes(public.verificationSetup.selection);
 
-#ifndef SIMULATOR
-              COPYN(SIZE_H, public.prove.context, public.verificationSetup.context);
-              debugHash("Initialised context", public.prove.context);
-#else // SIMULATOR
-              COPYN(SIZE_H, session.prove.context, public.verificationSetup.context);
-              debugHash("Initialised context", session.prove.context);
-#endif // SIMULATOR
+          if (pin_required && !pin_verified(credPIN)) {
+            credential = NULL;
+            ReturnSW(ISO7816_SW_SECURITY_STATUS_NOT_SATISFIED);
+          }
 
-              // Create new log entry
-              log_new_entry();
-              COPYN(SIZE_TIMESTAMP, log->timestamp, public.verificationSetup.timestamp);
-              COPYN(SIZE_TERMINAL_ID, log->terminal, terminal);
-              log->action = ACTION_PROVE;
-              log->credential = credential->id;
-              log->details.prove.selection = session.prove.disclose;
+          COPYN(SIZE_H, session.prove.context, public.verificationSetup.context);
+          debugHash("Initialised context", session.prove.context);
 
-              ReturnSW(ISO7816_SW_NO_ERROR);
-            }
+          // Create new log entry
+          log_new_entry();
+          COPYN(SIZE_TIMESTAMP, log->timestamp, public.verificationSetup.timestamp);
+          COPYN(SIZE_TERMINAL_ID, log->terminal, terminal);
+          log->action = ACTION_PROVE;
+          log->credential = credential->id;
+          log->details.prove.selection = session.prove.disclose;
+
+          // Precompute A' and ZTilde before the nonce arrives, if requested
+          if (P1 == P1_PROVE_PRECOMPUTE) {
+            precomputeProof();
+          }
+
+          ReturnSW(ISO7816_SW_NO_ERROR);
+
+        case INS_PROVE_REFILL:
+          debugMessage("INS_PROVE_REFILL");
+          if (!pin_verified(cardPIN)) {
+            ReturnSW(ISO7816_SW_SECURITY_STATUS_NOT_SATISFIED);
+          }
+          if (!((wrapped || CheckCase(3)) && Lc == sizeof(AttributeMask))) {
+            ReturnSW(ISO7816_SW_WRONG_LENGTH);
+          }
+          if (P1P2 == 0) {
+            ReturnSW(ISO7816_SW_WRONG_P1P2);
+          }
+
+          // Limit the EEPROM writes to filling the pool once per session
+          if (refills >= SIZE_POOL) {
+            debugWarning("Proof commitment pool already refilled");
+            ReturnSW(ISO7816_SW_COMMAND_NOT_ALLOWED);
+          }
+
+          // Refilling reuses the session memory of a pending proof or issuance
+          flags &= ~(FLAG_ISSUE_PRECOMPUTED | FLAG_ISSUE_COMMITTED | FLAG_ISSUE_SIGNED | FLAG_ISSUE_BULK | FLAG_PROVE_PRECOMPUTED | FLAG_PROVE_CHALLENGED);
+          staged = 0;
+
+          // Lookup the given credential ID and precompute a commitment for it
+          i = credential_lookup(P1P2);
+          if (i != MAX_CRED) {
+            credential = &credentials[i];
+            selectAttributes(public.poolSetup.selection);
+            pushProofCommitment();
+            refills++;
+            credential = NULL;
+            ReturnSW(ISO7816_SW_NO_ERROR);
           }
           ReturnSW(ISO7816_SW_REFERENCED_DATA_NOT_FOUND);
 
@@ -629,9 +879,24 @@ void main(void) {
             ReturnSW(ISO7816_SW_WRONG_LENGTH);
           }
 
-          constructProof();
-          debugHash("Returned c", public.apdu.data);
-          ReturnLa(ISO7816_SW_NO_ERROR, SIZE_H);
+          switch (P1) {
+            case P1_COMMITMENT_CHALLENGE:
+              constructProof();
+              debugHash("Returned c", public.apdu.data);
+              ReturnLa(ISO7816_SW_NO_ERROR, SIZE_H);
+
+#if SIZE_PROOF <= SIZE_PUBLIC
+            case P1_COMMITMENT_BULK:
+              constructProof();
+              i = constructProofResponse();
+              debugValue("Returned proof", public.apdu.data, i);
+              ReturnLa(ISO7816_SW_NO_ERROR, i);
+#endif // SIZE_PROOF <= SIZE_PUBLIC
+
+            default:
+              debugWarning("Unknown parameter");
+              ReturnSW(ISO7816_SW_WRONG_P1P2);
+          }
 
         case INS_PROVE_SIGNATURE:
           debugMessage("INS_PROVE_SIGNATURE");
@@ -641,6 +906,9 @@ void main(void) {
           if (credential == NULL) {
             ReturnSW(ISO7816_SW_CONDITIONS_NOT_SATISFIED);
           }
+          if ((flags & FLAG_PROVE_CHALLENGED) == 0) {
+            ReturnSW(ISO7816_SW_CONDITIONS_NOT_SATISFIED);
+          }
 
           switch(P1) {
             case P1_SIGNATURE_A:
@@ -649,11 +917,7 @@ void main(void) {
                 ReturnSW(ISO7816_SW_WRONG_LENGTH);
               }
 
-#ifndef SIMULATOR
-              COPYN(SIZE_N, public.apdu.data, public.prove.APrime);
-#else // SIMULATOR
-              COPYN(SIZE_N, public.apdu.data, session.prove.APrime);
-#endif // SIMULATOR
+              memcpy(public.apdu.data, session.prove.APrime, SIZE_N);
               debugNumber("Returned A'", public.apdu.data);
               ReturnLa(ISO7816_SW_NO_ERROR, SIZE_N);
 
@@ -678,9 +942,9 @@ void main(void) {
               }
 
 #ifndef SIMULATOR
-              COPYN(SIZE_V_, public.apdu.data, public.prove.vHat);
+              memcpy(public.apdu.data, public.prove.vHat, SIZE_V_);
 #else // SIMULATOR
-              COPYN(SIZE_V_, public.apdu.data, session.prove.vHat);
+              memcpy(public.apdu.data, session.prove.vHat, SIZE_V_);
 #endif // SIMULATOR
               debugValue("Returned v^", public.apdu.data, SIZE_V_);
               ReturnLa(ISO7816_SW_NO_ERROR, SIZE_V_);
@@ -704,13 +968,16 @@ void main(void) {
           if (P1 > credential->size) {
             ReturnSW(ISO7816_SW_WRONG_P1P2);
           }
+          if ((flags & FLAG_PROVE_CHALLENGED) == 0) {
+            ReturnSW(ISO7816_SW_CONDITIONS_NOT_SATISFIED);
+          }
 
           if (disclosed(P1)) {
             COPYN(SIZE_M, public.apdu.data, credential->attribute[P1 - 1]);
             debugValue("Returned attribute", public.apdu.data, SIZE_M);
             ReturnLa(ISO7816_SW_NO_ERROR, SIZE_M);
           } else {
-            COPYN(SIZE_M_, public.apdu.data, session.prove.mHat[P1]);
+            constructResponseM(P1, public.apdu.data);
             debugValue("Returned response", public.apdu.data, SIZE_M_);
             ReturnLa(ISO7816_SW_NO_ERROR, SIZE_M_);
           }
@@ -729,8 +996,12 @@ void main(void) {
             ReturnSW(ISO7816_SW_WRONG_LENGTH);
           }
 
-          for (i = 0; i < MAX_CRED; i++) {
-            ((short*) public.apdu.data)[i] = credentials[i].id;
+          // Only list the identifiers of occupied slots
+          for (k = 0; k < MAX_CRED; k++) {
+            i = (credentialIndex.used[k / 8] & (1 << (k % 8))) != 0 ?
+              credentialIndex.id[k] : 0;
+            public.apdu.data[2*k] = i >> 8;
+            public.apdu.data[2*k + 1] = i & 0xFF;
           }
 
           ReturnLa(ISO7816_SW_NO_ERROR, 2*MAX_CRED);
@@ -749,11 +1020,11 @@ void main(void) {
           }
 
           // Lookup the given credential ID and select it if it exists
-          for (i = 0; i < MAX_CRED; i++) {
-            if (credentials[i].id == P1P2) {
-              credential = &credentials[i];
-              ReturnSW(ISO7816_SW_NO_ERROR);
-            }
+          i = credential_lookup(P1P2);
+          if (i != MAX_CRED) {
+            credential = &credentials[i];
+            staged &= ~STAGED_SIGNATURE_Q;
+            ReturnSW(ISO7816_SW_NO_ERROR);
           }
           ReturnSW(ISO7816_SW_REFERENCED_DATA_NOT_FOUND);
           break;
@@ -796,7 +1067,7 @@ void main(void) {
 
           // Verify the given credential ID and remove it if it matches
           if (credential->id == P1P2) {
-            crypto_clear_credential();
+            removeCredential();
             debugInteger("Removed credential", P1P2);
 
             // Create new log entry
@@ -836,20 +1107,101 @@ void main(void) {
             ReturnLa(ISO7816_SW_NO_ERROR, 2 * sizeof(CredentialFlags));
           }
 
-        case INS_ADMIN_LOG:
-          debugMessage("INS_ADMIN_LOG");
+        case INS_ADMIN_DIRECTORY:
+          debugMessage("INS_ADMIN_DIRECTORY");
           if (!pin_verified(cardPIN)) {
             ReturnSW(ISO7816_SW_SECURITY_STATUS_NOT_SATISFIED);
           }
           if (!(wrapped || CheckCase(1))) {
             ReturnSW(ISO7816_SW_WRONG_LENGTH);
           }
+          if (P1 >= MAX_CRED || P2 != 0) {
+            ReturnSW(ISO7816_SW_WRONG_P1P2);
+          }
+
+          // Describe each occupied slot from slot P1 onwards, while they fit:
+          //   id | size | issuer flags | user flags | issuer key fingerprint
+          length = SIZE_DIRECTORY_HEADER;
+          for (k = P1; k < MAX_CRED && length + SIZE_DIRECTORY_ENTRY <= 255; k++) {
+            if ((credentialIndex.used[k / 8] & (1 << (k % 8))) == 0) {
+              continue;
+            }
+            public.apdu.data[length++] = credentials[k].id >> 8;
+            public.apdu.data[length++] = credentials[k].id & 0xFF;
+            public.apdu.data[length++] = credentials[k].size;
+            memcpy(public.apdu.data + length, &credentials[k].issuerFlags, sizeof(CredentialFlags));
+            length += sizeof(CredentialFlags);
+            memcpy(public.apdu.data + length, &credentials[k].userFlags, sizeof(CredentialFlags));
+            length += sizeof(CredentialFlags);
+            memcpy(public.apdu.data + length, issuerKeys[credentials[k].issuer].fingerprint, SIZE_FINGERPRINT);
+            length += SIZE_FINGERPRINT;
+          }
+
+          // Skip the empty slots, such that the last page reports MAX_CRED
+          while (k < MAX_CRED && (credentialIndex.used[k / 8] & (1 << (k % 8))) == 0) {
+            k++;
+          }
+
+          // Prefix the slot at which the next page starts (MAX_CRED if done)
+          public.apdu.data[0] = k;
+          debugValue("Returned directory", public.apdu.data, length);
+          ReturnLa(ISO7816_SW_NO_ERROR, length);
+
+        case INS_ADMIN_LOG:
+          debugMessage("INS_ADMIN_LOG");
+          if (!pin_verified(cardPIN)) {
+            ReturnSW(ISO7816_SW_SECURITY_STATUS_NOT_SATISFIED);
+          }
+
+          switch (P2) {
+            case P2_LOG_INDEX:
+              if (!(wrapped || CheckCase(1))) {
+                ReturnSW(ISO7816_SW_WRONG_LENGTH);
+              }
+
+              for (i = 0; i < (int) (255 / sizeof(LogEntry)); i++) {
+                log_get_entry(P1 + i);
+                memcpy(public.apdu.data + i*sizeof(LogEntry), log, sizeof(LogEntry));
+              }
+              ReturnLa(ISO7816_SW_NO_ERROR, (255 / sizeof(LogEntry)) * sizeof(LogEntry));
+
+            case P2_LOG_SINCE:
+              // Return the entries from sequence number "since" onwards
+              // (oldest first), as far as they are still in the log
+              if (!((wrapped || CheckCase(4)) && Lc == 2)) {
+                ReturnSW(ISO7816_SW_WRONG_LENGTH);
+              }
+              i = (public.apdu.data[0] << 8) | public.apdu.data[1];
+              if ((uint) i > logSequence) {
+                debugWarning("Sequence number ahead of the log");
+                ReturnSW(ISO7816_SW_WRONG_DATA);
+              }
+
+              // Limit the distance to the min(logSequence, SIZE_LOG) entries
+              // that have actually been logged
+              i = (uint) (logSequence - i);
+              if ((uint) i > SIZE_LOG) {
+                // Older than the log, return all of it
+                i = SIZE_LOG;
+              }
 
-          for (i = 0; i < 255 / sizeof(LogEntry); i++) {
-            log_get_entry(P1 + i);
-            memcpy(public.apdu.data + i*sizeof(LogEntry), log, sizeof(LogEntry));
+              // Encode the entries after the header while they fit
+              length = SIZE_LOG_HEADER;
+              for (k = 0; i > 0 && length + sizeof(LogEntry) <= 255; k++, i--) {
+                log_get_entry(i - 1);
+                length += log_encode_entry(log, public.apdu.data + length);
+              }
+              i = (uint) (logSequence - i - k);
+              public.apdu.data[0] = i >> 8;
+              public.apdu.data[1] = i & 0xFF;
+              public.apdu.data[2] = k;
+              debugInteger("Returned log entries", k);
+              ReturnLa(ISO7816_SW_NO_ERROR, length);
+
+            default:
+              debugWarning("Unknown parameter");
+              ReturnSW(ISO7816_SW_WRONG_P1P2);
           }
-          ReturnLa(ISO7816_SW_NO_ERROR, (255 / sizeof(LogEntry)) * sizeof(LogEntry));
           break;
 
         //////////////////////////////////////////////////////////////
@@ -44,14 +44,11 @@ union {
 /********************************************************************/
 #pragma melsession
 
-
 struct {
-  Byte pre[SIZE_M - SIZE_H];
-  Challenge c;
-  } challenge;
-CLMessages messages;
-ResponseM mHat[SIZE_L];
-Byte buffer[2*SIZE_M + SIZE_M_];
+  Hash c;
+  Byte m[SIZE_M];
+  ResponseM mHat;
+} ram;
 
 
 /********************************************************************/
@@ -67,21 +64,22 @@ Byte buffer[2*SIZE_M + SIZE_M_];
 void main(void) {
   switch (INS) {
     case 0x01:
-      COPYN(SIZE_H, challenge.c, apdu.data);
+      COPYN(SIZE_H, ram.c, apdu.data);
       ExitSW(ISO7816_SW_NO_ERROR);
-      
+
     case 0x02:
-      COPYN(SIZE_M, messages[0], apdu.data);
+      COPYN(SIZE_M, ram.m, apdu.data);
       ExitSW(ISO7816_SW_NO_ERROR);
 
     case 0x03:
-      COPYN(SIZE_M_, mHat[0], apdu.data);
+      COPYN(SIZE_M_, ram.mHat, apdu.data);
       ExitSW(ISO7816_SW_NO_ERROR);
 
     case 0x10:
-      crypto_compute_mHat(challenge.pre, 0);
-      COPYN(SIZE_M_, apdu.data, mHat[0]);
-      ExitSWLa(ISO7816_SW_NO_ERROR, SIZE_M_);
+      // mHat = mTilde + c*m, as in crypto_compute_mHat()
+      crypto_multiply_add(ram.mHat, SIZE_M_, ram.c, SIZE_H, ram.m, SIZE_M, 0);
+      COPYN(SIZE_M_, apdu.data, ram.mHat);
+      ExitLa(SIZE_M_);
       break;
     
     // Unknown instruction
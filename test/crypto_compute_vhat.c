@@ -44,16 +44,15 @@ union {
 /********************************************************************/
 #pragma melsession
 
-
 struct {
-  Byte pre[SIZE_VPRIME/2 - SIZE_H];
-  Challenge c;
-} challenge;
-Byte vPrime[SIZE_VPRIME];
-ResponseV vHat;
-Byte buffer[SIZE_VPRIME_ + SIZE_VPRIME];
-CLMessages messages;
-ResponseM mHat[SIZE_L];
+  Hash c;
+  Byte v[SIZE_V];
+  Byte e[SIZE_E];
+  Byte rA[SIZE_R_A];
+  Byte vPrime[SIZE_V];
+  ResponseV vHat;
+} ram;
+
 
 /********************************************************************/
 /* EEPROM variable declarations                                     */
@@ -68,21 +67,38 @@ ResponseM mHat[SIZE_L];
 void main(void) {
   switch (INS) {
     case 0x01:
-      COPYN(SIZE_H, challenge.c, apdu.data);
+      COPYN(SIZE_H, ram.c, apdu.data);
       ExitSW(ISO7816_SW_NO_ERROR);
-      
+
     case 0x02:
-      COPYN(SIZE_VPRIME, vPrime, apdu.data);
+      COPYN(SIZE_V, ram.v, apdu.data);
       ExitSW(ISO7816_SW_NO_ERROR);
 
     case 0x03:
-      COPYN(SIZE_VPRIME_, vHat, apdu.data);
+      COPYN(SIZE_E, ram.e, apdu.data);
+      ExitSW(ISO7816_SW_NO_ERROR);
+
+    case 0x04:
+      COPYN(SIZE_R_A, ram.rA, apdu.data);
+      ExitSW(ISO7816_SW_NO_ERROR);
+
+    case 0x05:
+      COPYN(SIZE_V_, ram.vHat, apdu.data);
       ExitSW(ISO7816_SW_NO_ERROR);
 
     case 0x10:
-      crypto_compute_vHat(challenge.pre, vPrime);
-      COPYN(SIZE_VPRIME_, apdu.data, vHat);
-      ExitSWLa(ISO7816_SW_NO_ERROR, SIZE_VPRIME_);
+      // v' = v - e*r_A, as in crypto_compute_vPrime()
+      COPYN(SIZE_V, ram.vPrime, ram.v);
+      crypto_multiply_add(ram.vPrime, SIZE_V, ram.e, SIZE_E, ram.rA, SIZE_R_A, 1);
+      COPYN(SIZE_V, apdu.data, ram.vPrime);
+      ExitLa(SIZE_V);
+      break;
+
+    case 0x11:
+      // vHat = vTilde + c*v', as in crypto_compute_vHat()
+      crypto_multiply_add(ram.vHat, SIZE_V_, ram.c, SIZE_H, ram.vPrime, SIZE_V, 0);
+      COPYN(SIZE_V_, apdu.data, ram.vHat);
+      ExitLa(SIZE_V_);
       break;
     
     // Unknown instruction
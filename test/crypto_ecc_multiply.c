@@ -0,0 +1,101 @@
+/**
+ * crypto_ecc_multiply.c
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope t_ it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ *
+ * Copyright (C) agent <agent@local>, October 2026.
+ */
+
+// Name everything "idemix"
+#pragma attribute("aid", "69 64 65 6D 69 78")
+#pragma attribute("dir", "61 10 4f 6 69 64 65 6D 69 78 50 6 69 64 65 6D 69 78")
+
+#include <ISO7816.h>
+#include <multosarith.h> // for COPYN()
+#include <multosccr.h> // for ZFlag()
+#include <multoscomms.h>
+#include <multoscrypto.h>
+
+#include "defs_sizes.h"
+#include "defs_types.h"
+#include "crypto_helper.h"
+#include "crypto_multos.h"
+
+/********************************************************************/
+/* APDU buffer variable declaration                                 */
+/********************************************************************/
+#pragma melpublic
+
+union {
+  Byte data[255];
+  Byte point[SIZE_ECC_POINT];
+} apdu;
+
+
+/********************************************************************/
+/* RAM variable declaration                                         */
+/********************************************************************/
+#pragma melsession
+
+struct {
+  Byte scalar[SIZE_ECC];
+  Byte point[SIZE_ECC_POINT];
+  Byte result[SIZE_ECC_POINT];
+} ram;
+
+Byte flag;
+
+
+/********************************************************************/
+/* EEPROM variable declarations                                     */
+/********************************************************************/
+#pragma melstatic
+
+
+/********************************************************************/
+/* APDU handling                                                    */
+/********************************************************************/
+
+void main(void) {
+  switch (INS) {
+    case 0x01:
+      if (Lc != SIZE_ECC) {
+        ExitSW(ISO7816_SW_WRONG_LENGTH);
+      }
+      COPYN(SIZE_ECC, ram.scalar, apdu.data);
+      ExitSW(ISO7816_SW_NO_ERROR);
+
+    case 0x02:
+      if (Lc != SIZE_ECC_POINT) {
+        ExitSW(ISO7816_SW_WRONG_LENGTH);
+      }
+      COPYN(SIZE_ECC_POINT, ram.point, apdu.point);
+      ExitSW(ISO7816_SW_NO_ERROR);
+
+    case 0x10:
+      crypto_ecc_verify(eccDomain, ram.point);
+      ZFlag(&flag);
+      if (flag == 0) {
+        ExitSW(ISO7816_SW_WRONG_DATA);
+      }
+      crypto_ecc_multiply(eccDomain, ram.point, ram.scalar, ram.result);
+      COPYN(SIZE_ECC_POINT, apdu.point, ram.result);
+      ExitLa(SIZE_ECC_POINT);
+      break;
+
+    // Unknown instruction
+    default:
+      ExitSW(ISO7816_SW_INS_NOT_SUPPORTED);
+  }
+}
@@ -0,0 +1,107 @@
+/**
+ * crypto_modexp_product.c
+ * 
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope t_ it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * 
+ * Copyright (C) agent <agent@local>, October 2026.
+ */
+
+// Name everything "idemix"
+#pragma attribute("aid", "69 64 65 6D 69 78")
+#pragma attribute("dir", "61 10 4f 6 69 64 65 6D 69 78 50 6 69 64 65 6D 69 78")
+
+#include <ISO7816.h>
+#include <multosarith.h> // for COPYN()
+#include <multoscomms.h>
+#include <string.h> // for memcpy()
+
+#include "defs_sizes.h"
+#include "defs_types.h"
+#include "crypto_helper.h"
+
+#define COUNT 3
+
+/********************************************************************/
+/* APDU buffer variable declaration                                 */
+/********************************************************************/
+#pragma melpublic
+
+union {
+  Byte data[255];
+  Number number;
+} apdu;
+
+
+/********************************************************************/
+/* RAM variable declaration                                         */
+/********************************************************************/
+#pragma melsession
+
+struct {
+  Number n;
+  Number base[COUNT];
+  Byte exponent[COUNT][SIZE_N];
+  Power power[COUNT];
+  Number result;
+  Number buffer;
+} ram;
+
+
+/********************************************************************/
+/* EEPROM variable declarations                                     */
+/********************************************************************/
+#pragma melstatic
+
+
+/********************************************************************/
+/* APDU handling                                                    */
+/********************************************************************/
+
+void main(void) {
+  switch (INS) {
+    case 0x01:
+      COPYN(SIZE_N, ram.n, apdu.number);
+      ExitSW(ISO7816_SW_NO_ERROR);
+
+    case 0x02:
+      if (P1 >= COUNT) {
+        ExitSW(ISO7816_SW_WRONG_P1P2);
+      }
+      COPYN(SIZE_N, ram.base[P1], apdu.number);
+      ram.power[P1].base = ram.base[P1];
+      ExitSW(ISO7816_SW_NO_ERROR);
+
+    case 0x03:
+      if (P1 >= COUNT) {
+        ExitSW(ISO7816_SW_WRONG_P1P2);
+      }
+      if (Lc > SIZE_N) {
+        ExitSW(ISO7816_SW_WRONG_LENGTH);
+      }
+      memcpy(ram.exponent[P1], apdu.data, Lc);
+      ram.power[P1].exponent = ram.exponent[P1];
+      ram.power[P1].size = Lc;
+      ExitSW(ISO7816_SW_NO_ERROR);
+
+    case 0x10:
+      crypto_modexp_product(ram.power, COUNT, ram.n, ram.result, ram.buffer);
+      COPYN(SIZE_N, apdu.number, ram.result);
+      ExitLa(SIZE_N);
+      break;
+    
+    // Unknown instruction
+    default:
+      ExitSW(ISO7816_SW_INS_NOT_SUPPORTED);
+  }
+}